@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "mock.h"
+#include "emulator.h"
+#include "../dongle/dongle.h"
+#include "../utils/log.h"
+#include "../utils/stats.h"
+
+#include <cstdlib>
+#include <memory>
+
+// Number of pairing status changes to measure
+#define BENCH_ITERATIONS 1000
+
+/*
+ * Runs the dongle's initialization against an emulated device
+ * Measures round trips of MCU commands afterwards
+ * Needs the firmware, but no hardware
+ */
+int main(int argc, char *argv[])
+{
+    using Clock = LatencyHistogram::Clock;
+
+    Log::init();
+    Log::info("xow-bench %s", VERSION);
+
+    long iterations = argc > 1
+        ? std::strtol(argv[1], nullptr, 10)
+        : BENCH_ITERATIONS;
+
+    if (iterations <= 0)
+    {
+        Log::error("Invalid number of iterations");
+
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<MockDevice> device(new MockDevice([] {
+        Log::error("Emulated device failed");
+    }));
+
+    // Outlives the device, which is owned by the dongle
+    Emulator emulator(*device);
+    std::unique_ptr<Dongle> dongle;
+
+    try
+    {
+        dongle.reset(new Dongle(std::move(device)));
+    }
+
+    catch (std::exception &exception)
+    {
+        Log::error("Error initializing dongle: %s", exception.what());
+
+        return EXIT_FAILURE;
+    }
+
+    LatencyHistogram pairing;
+
+    // Each change writes the beacon and awaits the responses
+    for (long i = 0; i < iterations; i++)
+    {
+        Clock::time_point start = Clock::now();
+
+        if (!dongle->setPairingStatus(i % 2 == 0))
+        {
+            Log::error("Failed to change pairing status");
+
+            return EXIT_FAILURE;
+        }
+
+        pairing.record(Clock::now() - start);
+    }
+
+    Log::info("Pairing status changes: %s", pairing.format().c_str());
+
+    dongle->logStats();
+
+    return EXIT_SUCCESS;
+}
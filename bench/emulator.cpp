@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "emulator.h"
+#include "../utils/log.h"
+
+#include <algorithm>
+#include <functional>
+
+// Endpoints used for commands and their responses
+#define EMULATOR_EP_READ 5
+#define EMULATOR_EP_WRITE 4
+
+// Vendor request for device mode changes
+#define EMULATOR_VEND_DEV_MODE 0x01
+
+// Device modes that start or reset the firmware
+#define EMULATOR_FW_RESET_IVB 0x01
+#define EMULATOR_FW_LOAD_IVB 0x12
+
+// Firmware upload registers
+#define EMULATOR_FCE_DMA_ADDR 0x0230
+#define EMULATOR_FCE_DMA_LEN 0x0234
+#define EMULATOR_DMA_COMPLETE 0xc0000000
+
+// EFUSE is read in blocks of 16 bytes
+#define EMULATOR_EFUSE_CTRL 0x0024
+#define EMULATOR_EFUSE_KICK (1 << 30)
+#define EMULATOR_EFUSE_DATA_BASE 0x0028
+#define EMULATOR_EFUSE_BLOCK_SIZE 0x10
+#define EMULATOR_EFUSE_SIZE 0x100
+
+// Position of the wireless address in the EFUSE
+#define EMULATOR_EE_MAC_ADDR 0x04
+
+// Fields of the command info (TxInfoCommand)
+#define EMULATOR_TX_LENGTH(info) ((info) & 0xffff)
+#define EMULATOR_TX_SEQUENCE(info) (((info) >> 16) & 0x0f)
+#define EMULATOR_TX_COMMAND_PACKET(info) (((info) >> 30) == 0x01)
+
+// Fields of the response info (RxInfoCommand)
+// Event type zero signals a completed command
+#define EMULATOR_RX_LENGTH(length) ((length) & 0x3fff)
+#define EMULATOR_RX_SEQUENCE(sequence) ((sequence) << 16)
+#define EMULATOR_RX_CPU_PORT (0x01 << 27)
+
+Emulator::Emulator(MockDevice &device) : device(device)
+{
+    const Bytes address = { 0x62, 0x45, 0xbd, 0x00, 0x00, 0x01 };
+
+    efuse = Bytes(EMULATOR_EFUSE_SIZE);
+
+    std::copy(
+        address.begin(),
+        address.end(),
+        efuse.raw() + EMULATOR_EE_MAC_ADDR
+    );
+
+    device.setControlHandler(std::bind(
+        &Emulator::handleControl,
+        this,
+        std::placeholders::_1,
+        std::placeholders::_2
+    ));
+    device.setBulkHandler(std::bind(
+        &Emulator::handleBulk,
+        this,
+        std::placeholders::_1,
+        std::placeholders::_2
+    ));
+}
+
+bool Emulator::handleControl(UsbDevice::ControlPacket &packet, bool write)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (packet.request == EMULATOR_VEND_DEV_MODE)
+    {
+        // Firmware reports that it has started
+        if (packet.value == EMULATOR_FW_LOAD_IVB)
+        {
+            registers[EMULATOR_FCE_DMA_ADDR] = 0x01;
+        }
+
+        else if (packet.value == EMULATOR_FW_RESET_IVB)
+        {
+            registers[EMULATOR_FCE_DMA_ADDR] = 0;
+        }
+
+        return true;
+    }
+
+    if (packet.length != sizeof(uint32_t))
+    {
+        Log::error("Unexpected control transfer of %d bytes", packet.length);
+
+        return false;
+    }
+
+    uint32_t value = 0;
+
+    if (!write)
+    {
+        value = registers[packet.index];
+
+        std::copy(
+            reinterpret_cast<uint8_t*>(&value),
+            reinterpret_cast<uint8_t*>(&value) + sizeof(value),
+            packet.data
+        );
+
+        return true;
+    }
+
+    std::copy(
+        packet.data,
+        packet.data + sizeof(value),
+        reinterpret_cast<uint8_t*>(&value)
+    );
+
+    switch (packet.index)
+    {
+        // DMA transfers complete immediately
+        case EMULATOR_FCE_DMA_LEN:
+            value |= EMULATOR_DMA_COMPLETE;
+            break;
+
+        // Reads complete immediately
+        case EMULATOR_EFUSE_CTRL:
+            readEfuse(value);
+            value &= ~EMULATOR_EFUSE_KICK;
+            break;
+    }
+
+    registers[packet.index] = value;
+
+    return true;
+}
+
+bool Emulator::handleBulk(uint8_t endpoint, const Bytes &data)
+{
+    // WLAN packets are not answered
+    if (endpoint != EMULATOR_EP_WRITE)
+    {
+        return true;
+    }
+
+    const uint8_t *position = data.raw();
+    const uint8_t *end = position + data.size();
+
+    // Multiple commands can be sent in a single transfer
+    // 32 zero-bits mark the end
+    while (end - position >= static_cast<long>(sizeof(uint32_t)))
+    {
+        uint32_t info = 0;
+
+        std::copy(
+            position,
+            position + sizeof(info),
+            reinterpret_cast<uint8_t*>(&info)
+        );
+
+        if (!info)
+        {
+            break;
+        }
+
+        // Firmware chunks do not expect a response
+        uint8_t sequence = EMULATOR_TX_SEQUENCE(info);
+
+        if (EMULATOR_TX_COMMAND_PACKET(info) && sequence)
+        {
+            respond(sequence);
+        }
+
+        position += sizeof(info) + EMULATOR_TX_LENGTH(info);
+    }
+
+    return true;
+}
+
+void Emulator::readEfuse(uint32_t control)
+{
+    // Address is located in bits 16 - 25
+    uint16_t address = (control >> 16) & 0x03ff;
+
+    if (
+        !(control & EMULATOR_EFUSE_KICK) ||
+        address + EMULATOR_EFUSE_BLOCK_SIZE > static_cast<int>(efuse.size())
+    ) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < EMULATOR_EFUSE_BLOCK_SIZE; i += sizeof(uint32_t))
+    {
+        uint32_t value = 0;
+
+        std::copy(
+            efuse.raw() + address + i,
+            efuse.raw() + address + i + sizeof(value),
+            reinterpret_cast<uint8_t*>(&value)
+        );
+
+        registers[EMULATOR_EFUSE_DATA_BASE + i] = value;
+    }
+}
+
+void Emulator::respond(uint8_t sequence)
+{
+    // Aggregated frames must not be empty
+    uint32_t info = EMULATOR_RX_LENGTH(sizeof(uint32_t)) |
+        EMULATOR_RX_SEQUENCE(sequence) |
+        EMULATOR_RX_CPU_PORT;
+    Bytes response;
+
+    // End marker is identical to the header
+    response.append(info);
+    response.append<uint32_t>(0);
+    response.append(info);
+
+    device.queueRead(EMULATOR_EP_READ, response);
+}
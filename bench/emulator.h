@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include "mock.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+/*
+ * Emulates the dongle's chip and firmware on top of a mock device
+ * Implements the registers polled while initializing
+ * Acknowledges every MCU command that requests a response
+ * Register addresses and message layouts are taken from mt76.cpp
+ */
+class Emulator
+{
+public:
+    Emulator(MockDevice &device);
+
+private:
+    bool handleControl(UsbDevice::ControlPacket &packet, bool write);
+    bool handleBulk(uint8_t endpoint, const Bytes &data);
+    void readEfuse(uint32_t control);
+    void respond(uint8_t sequence);
+
+    MockDevice &device;
+
+    std::mutex mutex;
+    std::map<uint16_t, uint32_t> registers;
+    Bytes efuse;
+};
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "mock.h"
+#include "../utils/log.h"
+
+#include <algorithm>
+
+using Clock = LatencyHistogram::Clock;
+
+MockDevice::MockDevice(
+    Terminate terminate
+) : terminate(terminate),
+    pool(USB_READ_BUFFERS, USB_MAX_READ_SIZE)
+{
+    readThread = std::thread(&MockDevice::deliverReads, this);
+}
+
+MockDevice::~MockDevice()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    stopReads = true;
+    readCondition.notify_all();
+    lock.unlock();
+
+    readThread.join();
+}
+
+void MockDevice::controlTransfer(ControlPacket packet, bool write)
+{
+    TransferStats &stats = endpointStats(0);
+    Clock::time_point start = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    std::shared_ptr<ControlHandler> handler = controlHandler;
+
+    controlCount++;
+    lock.unlock();
+
+    if (handler)
+    {
+        if (!(*handler)(packet, write))
+        {
+            Log::error("Error in mock control transfer");
+
+            stats.recordError();
+            terminate();
+
+            return;
+        }
+
+        stats.recordTransfer(packet.length, Clock::now() - start);
+
+        return;
+    }
+
+    lock.lock();
+
+    if (write)
+    {
+        registers[packet.index] = Bytes(
+            packet.data,
+            packet.data + packet.length
+        );
+        stats.recordTransfer(packet.length, Clock::now() - start);
+
+        return;
+    }
+
+    std::deque<Bytes> &queue = responses[packet.index];
+    Bytes response = registers[packet.index];
+
+    if (!queue.empty())
+    {
+        response = queue.front();
+        queue.pop_front();
+    }
+
+    // Missing data reads as zeros
+    std::fill(packet.data, packet.data + packet.length, 0);
+    std::copy(
+        response.begin(),
+        response.begin() + std::min<size_t>(response.size(), packet.length),
+        packet.data
+    );
+    stats.recordTransfer(packet.length, Clock::now() - start);
+}
+
+bool MockDevice::startRead(
+    uint8_t endpoint,
+    Receive receive,
+    size_t size
+) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (receivers.count(endpoint))
+    {
+        Log::error("Endpoint is already being read");
+
+        return false;
+    }
+
+    receivers[endpoint] = std::make_shared<Receive>(receive);
+    readSizes[endpoint] = std::min<size_t>(size, USB_MAX_READ_SIZE);
+
+    // Deliver data queued before reading started
+    readCondition.notify_all();
+
+    return true;
+}
+
+void MockDevice::stopRead()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    receivers.clear();
+    readSizes.clear();
+
+    // Receive handlers cannot wait for themselves
+    if (std::this_thread::get_id() == readThread.get_id())
+    {
+        return;
+    }
+
+    // Waits for data that is currently being delivered
+    readCondition.wait(lock, [this] { return !delivering; });
+}
+
+bool MockDevice::bulkWrite(uint8_t endpoint, Bytes &data)
+{
+    TransferStats &stats = endpointStats(endpoint);
+    Clock::time_point start = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    std::shared_ptr<BulkHandler> handler = bulkHandler;
+
+    bulkCount++;
+    lock.unlock();
+
+    if (handler && !(*handler)(endpoint, data))
+    {
+        Log::error("Error in mock bulk write");
+
+        stats.recordError();
+        terminate();
+
+        return false;
+    }
+
+    stats.recordTransfer(data.size(), Clock::now() - start);
+
+    return true;
+}
+
+void MockDevice::setControlHandler(ControlHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    controlHandler = std::make_shared<ControlHandler>(handler);
+}
+
+void MockDevice::setBulkHandler(BulkHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    bulkHandler = std::make_shared<BulkHandler>(handler);
+}
+
+void MockDevice::queueControlResponse(uint16_t index, const Bytes &data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    responses[index].push_back(data);
+}
+
+void MockDevice::queueRead(uint8_t endpoint, const Bytes &data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    reads.push_back({ endpoint, data, Clock::now() });
+    readCondition.notify_all();
+}
+
+size_t MockDevice::getControlCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return controlCount;
+}
+
+size_t MockDevice::getBulkCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return bulkCount;
+}
+
+void MockDevice::deliverReads()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stopReads)
+    {
+        auto read = std::find_if(
+            reads.begin(),
+            reads.end(),
+            [this](const Read &pending) {
+                return receivers.count(pending.endpoint) > 0;
+            }
+        );
+
+        if (read == reads.end())
+        {
+            readCondition.wait(lock);
+
+            continue;
+        }
+
+        Read current = std::move(*read);
+        std::shared_ptr<Receive> receive = receivers[current.endpoint];
+        TransferStats &stats = endpointStats(
+            current.endpoint | LIBUSB_ENDPOINT_IN
+        );
+        PooledBytes buffer = pool.get();
+
+        reads.erase(read);
+
+        if (!buffer || current.data.size() > readSizes[current.endpoint])
+        {
+            Log::error("Mock read does not fit into buffer");
+
+            stats.recordError();
+
+            continue;
+        }
+
+        std::copy(current.data.begin(), current.data.end(), buffer.raw());
+        buffer.resize(current.data.size());
+        stats.recordTransfer(current.data.size());
+
+        // Data is considered to arrive when it gets queued
+        auto arrival = arrivals.find(current.endpoint);
+
+        if (arrival != arrivals.end())
+        {
+            stats.interval.record(current.queued - arrival->second);
+        }
+
+        arrivals[current.endpoint] = current.queued;
+        delivering = true;
+
+        lock.unlock();
+        (*receive)(buffer);
+        stats.processing.record(Clock::now() - current.queued);
+        buffer = PooledBytes();
+        lock.lock();
+
+        delivering = false;
+        readCondition.notify_all();
+    }
+}
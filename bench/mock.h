@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include "../dongle/usb.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * In-memory USB device without any hardware access
+ * Serves scripted responses to control transfers
+ * Delivers queued bulk data to the read handlers on a separate thread
+ */
+class MockDevice : public UsbDevice
+{
+public:
+    // Returning false fails the transfer
+    using ControlHandler = std::function<bool(
+        ControlPacket &packet,
+        bool write
+    )>;
+    using BulkHandler = std::function<bool(
+        uint8_t endpoint,
+        const Bytes &data
+    )>;
+
+    MockDevice(Terminate terminate);
+    ~MockDevice();
+
+    void controlTransfer(ControlPacket packet, bool write) override;
+    bool startRead(
+        uint8_t endpoint,
+        Receive receive,
+        size_t size = USB_MAX_BULK_TRANSFER_SIZE
+    ) override;
+    void stopRead() override;
+    bool bulkWrite(uint8_t endpoint, Bytes &data) override;
+
+    /* Scripting */
+    void setControlHandler(ControlHandler handler);
+    void setBulkHandler(BulkHandler handler);
+    void queueControlResponse(uint16_t index, const Bytes &data);
+    void queueRead(uint8_t endpoint, const Bytes &data);
+
+    size_t getControlCount();
+    size_t getBulkCount();
+
+private:
+    struct Read
+    {
+        uint8_t endpoint;
+        Bytes data;
+        LatencyHistogram::Clock::time_point queued;
+    };
+
+    void deliverReads();
+
+    Terminate terminate;
+    BytePool pool;
+
+    // Protects the scripted state, not the handlers
+    std::mutex mutex;
+    std::shared_ptr<ControlHandler> controlHandler;
+    std::shared_ptr<BulkHandler> bulkHandler;
+
+    // Written values are read back unless a response is queued
+    std::map<uint16_t, Bytes> registers;
+    std::map<uint16_t, std::deque<Bytes>> responses;
+
+    std::map<uint8_t, std::shared_ptr<Receive>> receivers;
+    std::map<uint8_t, size_t> readSizes;
+    std::map<uint8_t, LatencyHistogram::Clock::time_point> arrivals;
+
+    // Reads for endpoints that are not being read stay queued
+    // Handlers never run on the thread that queued the data
+    std::thread readThread;
+    std::condition_variable readCondition;
+    std::deque<Read> reads;
+    bool delivering = false;
+    bool stopReads = false;
+
+    size_t controlCount = 0;
+    size_t bulkCount = 0;
+};
@@ -18,7 +18,9 @@
 
 #include "controller.h"
 #include "../utils/log.h"
+#include "../utils/bytes.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
 #include <linux/input.h>
@@ -51,10 +53,23 @@ Controller::Controller(
         std::placeholders::_2,
         std::placeholders::_3
     )),
-    stopRumbleThread(false) {}
+    stopRumbleThread(false),
+    stopPacketThread(false),
+    packetsQueued(false)
+{
+    packetThread = std::thread(&Controller::processPackets, this);
+}
 
 Controller::~Controller()
 {
+    std::unique_lock<std::mutex> lock(packetMutex);
+
+    stopPacketThread = true;
+    packetCondition.notify_one();
+    lock.unlock();
+
+    packetThread.join();
+
     stopRumbleThread = true;
     rumbleCondition.notify_one();
 
@@ -273,6 +288,101 @@ void Controller::processRumble()
     }
 }
 
+bool Controller::queuePacket(ByteView data)
+{
+    Packet packet = {};
+
+    // Anything past the largest frame is padding
+    packet.length = std::min<size_t>(data.size(), CONTROLLER_PACKET_SIZE);
+
+    std::copy(data.begin(), data.begin() + packet.length, packet.data);
+
+    packet.sequence = ++packetSequence;
+
+    // Outdated input is replaced instead of queued
+    if (isInputPacket(data))
+    {
+        inputBuffer.put(packet);
+    }
+
+    else if (!packetRing.push(packet))
+    {
+        return false;
+    }
+
+    // Consumer has not cleared the flag yet and will see the packet
+    if (packetsQueued.exchange(true))
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(packetMutex);
+
+    packetCondition.notify_one();
+
+    return true;
+}
+
+void Controller::processPackets()
+{
+    Packet packet = {};
+    Packet input = {};
+
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(packetMutex);
+
+        packetCondition.wait(lock, [this] {
+            return packetsQueued || stopPacketThread;
+        });
+
+        if (stopPacketThread)
+        {
+            break;
+        }
+
+        lock.unlock();
+
+        // Synchronizes with the producer that set the flag
+        packetsQueued.exchange(false);
+
+        bool inputPending = inputBuffer.get(input);
+
+        while (packetRing.pop(packet))
+        {
+            if (!inputPending)
+            {
+                inputPending = inputBuffer.get(input);
+            }
+
+            // Input goes before the packets that arrived after it
+            if (inputPending && input.sequence < packet.sequence)
+            {
+                handleQueuedPacket(input);
+
+                inputPending = false;
+            }
+
+            handleQueuedPacket(packet);
+        }
+
+        if (inputPending || inputBuffer.get(input))
+        {
+            handleQueuedPacket(input);
+        }
+    }
+}
+
+void Controller::handleQueuedPacket(const Packet &packet)
+{
+    ByteView data(packet.data, packet.data + packet.length);
+
+    if (!handlePacket(data))
+    {
+        Log::error("Error handling packet");
+    }
+}
+
 void Controller::inputFeedbackReceived(
     uint16_t gain,
     ff_effect effect,
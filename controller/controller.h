@@ -21,15 +21,23 @@
 #include "gip.h"
 #include "input.h"
 #include "../utils/buffer.h"
+#include "../utils/ring.h"
 
 #include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
+// Largest GIP packet (4 byte header, up to 255 bytes of data)
+#define CONTROLLER_PACKET_SIZE (4 + 0xff)
+
+// Number of queued packets besides input
+#define CONTROLLER_QUEUE_SIZE 32
+
 /*
  * Forwards gamepad events to virtual input device
  * Passes force feedback effects to gamepad
+ * Received packets are handled on a separate thread
  */
 class Controller : public GipDevice
 {
@@ -37,7 +45,19 @@ public:
     Controller(SendPacket sendPacket);
     ~Controller();
 
+    // Returns false if the packet had to be dropped
+    bool queuePacket(ByteView packet);
+
 private:
+    struct Packet
+    {
+        uint8_t data[CONTROLLER_PACKET_SIZE];
+        size_t length;
+
+        // Order of arrival across the ring and the input buffer
+        uint64_t sequence;
+    };
+
     /* GIP events */
     void deviceAnnounced(uint8_t id, const AnnounceData *announce) override;
     void statusReceived(uint8_t id, const StatusData *status) override;
@@ -51,6 +71,10 @@ private:
     /* Rumble buffer consumer */
     void processRumble();
 
+    /* Packet queue consumer */
+    void processPackets();
+    void handleQueuedPacket(const Packet &packet);
+
     /* OS interface */
     void inputFeedbackReceived(
         uint16_t gain,
@@ -65,5 +89,21 @@ private:
     std::condition_variable rumbleCondition;
     Buffer<RumbleData> rumbleBuffer;
 
+    std::atomic<bool> stopPacketThread;
+    std::thread packetThread;
+    std::mutex packetMutex;
+    std::condition_variable packetCondition;
+    Ring<Packet, CONTROLLER_QUEUE_SIZE> packetRing;
+
+    // Cleared by the consumer before it drains the queues
+    // Producer only notifies when it sets the flag again
+    std::atomic<bool> packetsQueued;
+
+    // Only used by the producer
+    uint64_t packetSequence = 0;
+
+    // Only the newest input packet is kept
+    Buffer<Packet> inputBuffer;
+
     uint8_t batteryLevel = 0xff;
 };
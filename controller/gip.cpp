@@ -59,7 +59,7 @@ struct Frame
 
 GipDevice::GipDevice(SendPacket sendPacket) : sendPacket(sendPacket) {}
 
-bool GipDevice::handlePacket(const Bytes &packet)
+bool GipDevice::handlePacket(ByteView packet)
 {
     // Ignore invalid packets
     if (packet.size() < sizeof(Frame))
@@ -82,7 +82,7 @@ bool GipDevice::handlePacket(const Bytes &packet)
         return true;
     }
 
-    const Bytes data(packet, sizeof(Frame));
+    const ByteView data = packet.skip(sizeof(Frame));
 
     // Data is 32-bit aligned, check for minimum size
     if (
@@ -138,6 +138,17 @@ bool GipDevice::handlePacket(const Bytes &packet)
     return true;
 }
 
+bool GipDevice::isInputPacket(ByteView packet)
+{
+    const Frame *frame = packet.toStruct<Frame>();
+
+    // Packets that need to be acknowledged are never skipped
+    return frame &&
+        frame->command == CMD_INPUT &&
+        frame->deviceId == 0 &&
+        !(frame->type & TYPE_ACK);
+}
+
 bool GipDevice::setPowerMode(uint8_t id, PowerMode mode)
 {
     Frame frame = {};
@@ -23,6 +23,7 @@
 
 struct Frame;
 class Bytes;
+class ByteView;
 
 /*
  * Base class for GIP (Game Input Protocol) devices
@@ -44,7 +45,10 @@ class GipDevice
 public:
     using SendPacket = std::function<bool(const Bytes &data)>;
 
-    bool handlePacket(const Bytes &packet);
+    bool handlePacket(ByteView packet);
+
+    // Input packets only carry the latest state
+    static bool isInputPacket(ByteView packet);
 
 protected:
     enum BatteryType
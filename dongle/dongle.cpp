@@ -21,39 +21,94 @@
 
 Dongle::Dongle(
     std::unique_ptr<UsbDevice> usbDevice
-) : Mt76(std::move(usbDevice)), stopThreads(false)
+) : Mt76(std::move(usbDevice)), packetsInFlight(0), droppedPackets(0)
 {
     Log::info("Dongle initialized");
 
-    threads.emplace_back(
-        &Dongle::readBulkPackets,
-        this,
-        MT_EP_READ
-    );
-    threads.emplace_back(
-        &Dongle::readBulkPackets,
+    lifecycleThread = std::thread(&Dongle::processLifecycleEvents, this);
+
+    setPacketHandler(std::bind(
+        &Dongle::handleBulkData,
         this,
-        MT_EP_READ_PACKET
-    );
+        std::placeholders::_1
+    ));
 }
 
 Dongle::~Dongle()
 {
-    stopThreads = true;
+    // Waits for packets that are currently being handled
+    setPacketHandler(nullptr);
+
+    std::unique_lock<std::mutex> lock(lifecycleMutex);
+
+    // Remaining events are discarded
+    stopLifecycle = true;
+    lifecycleCondition.notify_one();
+    lock.unlock();
+
+    lifecycleThread.join();
+}
+
+void Dongle::logStats()
+{
+    Mt76::logStats();
+
+    Log::info(
+        "Dongle %s dropped controller packets: %llu",
+        Log::formatBytes(macAddress).c_str(),
+        static_cast<unsigned long long>(droppedPackets.load())
+    );
+}
+
+void Dongle::queueLifecycleEvent(LifecycleEvent event)
+{
+    std::lock_guard<std::mutex> lock(lifecycleMutex);
+
+    lifecycleEvents.push_back(event);
+    lifecycleCondition.notify_one();
+}
+
+void Dongle::processLifecycleEvents()
+{
+    std::unique_lock<std::mutex> lock(lifecycleMutex);
 
-    // Wait for all threads to shut down
-    for (std::thread &thread : threads)
+    while (true)
     {
-        if (thread.joinable())
+        lifecycleCondition.wait(lock, [this] {
+            return !lifecycleEvents.empty() || stopLifecycle;
+        });
+
+        if (stopLifecycle)
+        {
+            break;
+        }
+
+        LifecycleEvent event = lifecycleEvents.front();
+
+        lifecycleEvents.pop_front();
+        lock.unlock();
+
+        if (event.type == CONTROLLER_CONNECT)
+        {
+            connectController(event.address);
+        }
+
+        else
         {
-            thread.join();
+            disconnectController(event.wcid);
         }
+
+        lock.lock();
     }
 }
 
-void Dongle::handleControllerConnect(Bytes address)
+void Dongle::connectController(const Bytes &address)
 {
-    std::lock_guard<std::mutex> lock(controllerMutex);
+    std::unique_lock<std::mutex> lock(pendingMutex);
+
+    // Packets can arrive before the controller is ready
+    connecting = true;
+    lock.unlock();
 
     uint8_t wcid = associateClient(address);
 
@@ -61,6 +116,8 @@ void Dongle::handleControllerConnect(Bytes address)
     {
         Log::error("Failed to associate controller");
 
+        publishController(0, nullptr);
+
         return;
     }
 
@@ -71,29 +128,56 @@ void Dongle::handleControllerConnect(Bytes address)
         address,
         std::placeholders::_1
     );
+    std::shared_ptr<Controller> controller;
 
-    controllers[wcid - 1].reset(new Controller(sendPacket));
-
-    Log::info("Controller '%d' connected", wcid);
-}
+    try
+    {
+        controller = std::make_shared<Controller>(sendPacket);
+    }
 
-void Dongle::handleControllerDisconnect(uint8_t wcid)
-{
-    // Ignore invalid WCIDs
-    if (wcid == 0 || wcid > MT_WCID_COUNT)
+    catch (InputException &exception)
     {
+        Log::error("Failed to create controller: %s", exception.what());
+
+        publishController(0, nullptr);
+
+        if (!removeClient(wcid))
+        {
+            Log::error("Failed to remove controller");
+        }
+
         return;
     }
 
-    std::lock_guard<std::mutex> lock(controllerMutex);
+    if (!publishController(wcid, controller))
+    {
+        Log::error("Dropped packets for controller '%d'", wcid);
+    }
+
+    Log::info("Controller '%d' connected", wcid);
+}
+
+void Dongle::disconnectController(uint8_t wcid)
+{
+    std::shared_ptr<Controller> controller = std::atomic_exchange(
+        &controllers[wcid - 1],
+        std::shared_ptr<Controller>()
+    );
 
     // Ignore unconnected controllers
-    if (!controllers[wcid - 1])
+    if (!controller)
     {
         return;
     }
 
-    controllers[wcid - 1].reset();
+    // Packets being queued keep the controller alive
+    // Controller is destroyed on this thread, never on the event thread
+    std::unique_lock<std::mutex> lock(inFlightMutex);
+
+    inFlightCondition.wait(lock, [this] { return packetsInFlight == 0; });
+    lock.unlock();
+
+    controller.reset();
 
     if (!removeClient(wcid))
     {
@@ -105,22 +189,70 @@ void Dongle::handleControllerDisconnect(uint8_t wcid)
     Log::info("Controller '%d' disconnected", wcid);
 }
 
-void Dongle::handleControllerPair(Bytes address, const Bytes &packet)
+bool Dongle::publishController(
+    uint8_t wcid,
+    std::shared_ptr<Controller> controller
+) {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    bool successful = true;
+
+    // Queue packets that arrived during the connection first
+    // New packets wait for the lock until the controller is published
+    if (controller)
+    {
+        for (const Bytes &packet : pendingPackets[wcid])
+        {
+            if (!controller->queuePacket(packet))
+            {
+                successful = false;
+            }
+        }
+
+        std::atomic_store(&controllers[wcid - 1], controller);
+    }
+
+    // Packets for other WCIDs have no recipient
+    pendingPackets.clear();
+    connecting = false;
+
+    return successful;
+}
+
+void Dongle::handleControllerConnect(ByteView source)
 {
-    // Ignore invalid packets
-    if (packet.size() < sizeof(ReservedFrame))
+    // Address is kept by the controller's send function
+    queueLifecycleEvent({ CONTROLLER_CONNECT, source.toBytes(), 0 });
+}
+
+void Dongle::handleControllerDisconnect(uint8_t wcid)
+{
+    // Ignore invalid WCIDs
+    if (wcid == 0 || wcid > MT_WCID_COUNT)
     {
         return;
     }
 
+    queueLifecycleEvent({ CONTROLLER_DISCONNECT, Bytes(), wcid });
+}
+
+void Dongle::handleControllerPair(ByteView source, ByteView packet)
+{
     const ReservedFrame *frame = packet.toStruct<ReservedFrame>();
 
+    // Ignore invalid packets
+    if (!frame)
+    {
+        return;
+    }
+
     // Type 0x01 is for pairing requests
     if (frame->type != 0x01)
     {
         return;
     }
 
+    Bytes address = source.toBytes();
+
     if (!pairClient(address))
     {
         Log::error("Failed to pair controller");
@@ -141,7 +273,7 @@ void Dongle::handleControllerPair(Bytes address, const Bytes &packet)
     );
 }
 
-void Dongle::handleControllerPacket(uint8_t wcid, const Bytes &packet)
+void Dongle::handleControllerPacket(uint8_t wcid, ByteView packet)
 {
     // Invalid WCID
     if (wcid == 0 || wcid > MT_WCID_COUNT)
@@ -156,23 +288,62 @@ void Dongle::handleControllerPacket(uint8_t wcid, const Bytes &packet)
     }
 
     // Skip 2 bytes of padding
-    const Bytes data(packet, sizeof(QosFrame) + sizeof(uint16_t));
+    const ByteView data = packet.skip(sizeof(QosFrame) + sizeof(uint16_t));
 
-    std::lock_guard<std::mutex> lock(controllerMutex);
+    // Disconnected controllers are released once no packet holds them
+    packetsInFlight++;
+    queueControllerPacket(wcid, data);
 
-    // Ignore unconnected controllers
-    if (!controllers[wcid - 1])
+    if (--packetsInFlight == 0)
     {
-        return;
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+
+        inFlightCondition.notify_all();
     }
+}
+
+void Dongle::queueControllerPacket(uint8_t wcid, ByteView data)
+{
+    // Connecting and disconnecting never blocks packets
+    std::shared_ptr<Controller> controller = std::atomic_load(
+        &controllers[wcid - 1]
+    );
 
-    if (!controllers[wcid - 1]->handlePacket(data))
+    if (!controller)
     {
-        Log::error("Error handling packet for controller '%d'", wcid);
+        std::lock_guard<std::mutex> lock(pendingMutex);
+
+        // Controller might have been published in the meantime
+        controller = std::atomic_load(&controllers[wcid - 1]);
+
+        // Ignore unconnected controllers
+        if (!controller && !connecting)
+        {
+            return;
+        }
+
+        if (!controller)
+        {
+            std::deque<Bytes> &pending = pendingPackets[wcid];
+
+            if (pending.size() < DONGLE_PENDING_PACKETS)
+            {
+                pending.push_back(data.toBytes());
+            }
+
+            return;
+        }
+    }
+
+    // Packets are handled by the controller's own thread
+    // Drops are only counted, logging them would slow down the event thread
+    if (!controller->queuePacket(data))
+    {
+        droppedPackets.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
-void Dongle::handleWlanPacket(const Bytes &packet)
+void Dongle::handleWlanPacket(ByteView packet)
 {
     // Ignore invalid or empty packets
     if (packet.size() <= sizeof(RxWi) + sizeof(WlanFrame))
@@ -183,11 +354,11 @@ void Dongle::handleWlanPacket(const Bytes &packet)
     const RxWi *rxWi = packet.toStruct<RxWi>();
     const WlanFrame *wlanFrame = packet.toStruct<WlanFrame>(sizeof(RxWi));
 
-    const Bytes source(
+    const ByteView source(
         wlanFrame->source,
         wlanFrame->source + macAddress.size()
     );
-    const Bytes destination(
+    const ByteView destination(
         wlanFrame->destination,
         wlanFrame->destination + macAddress.size()
     );
@@ -219,28 +390,24 @@ void Dongle::handleWlanPacket(const Bytes &packet)
             // Reserved frames are used for different purposes
             // Most of them are yet to be discovered
             case MT_WLAN_RESERVED:
-                const Bytes innerPacket(
-                    packet,
-                    sizeof(RxWi) + sizeof(WlanFrame)
+                handleControllerPair(
+                    source,
+                    packet.skip(sizeof(RxWi) + sizeof(WlanFrame))
                 );
-
-                handleControllerPair(source, innerPacket);
                 break;
         }
     }
 
     else if (type == MT_WLAN_DATA && subtype == MT_WLAN_QOS_DATA)
     {
-        const Bytes innerPacket(
-            packet,
-            sizeof(RxWi) + sizeof(WlanFrame)
+        handleControllerPacket(
+            rxWi->wcid,
+            packet.skip(sizeof(RxWi) + sizeof(WlanFrame))
         );
-
-        handleControllerPacket(rxWi->wcid, innerPacket);
     }
 }
 
-void Dongle::handleBulkData(const Bytes &data)
+void Dongle::handleBulkData(ByteView data)
 {
     // Ignore invalid or empty data
     if (data.size() <= sizeof(RxInfoGeneric) + sizeof(uint32_t))
@@ -250,7 +417,10 @@ void Dongle::handleBulkData(const Bytes &data)
 
     // Skip packet end marker (4 bytes, identical to header)
     const RxInfoGeneric *rxInfo = data.toStruct<RxInfoGeneric>();
-    const Bytes packet(data, sizeof(RxInfoGeneric), sizeof(uint32_t));
+    const ByteView packet = data.skip(
+        sizeof(RxInfoGeneric),
+        sizeof(uint32_t)
+    );
 
     if (rxInfo->port == CPU_RX_PORT)
     {
@@ -259,7 +429,6 @@ void Dongle::handleBulkData(const Bytes &data)
         switch (info->eventType)
         {
             case EVT_BUTTON_PRESS:
-                // Setting the pairing status doesn't require locking the mutex
                 setPairingStatus(true);
                 break;
 
@@ -284,26 +453,3 @@ void Dongle::handleBulkData(const Bytes &data)
         }
     }
 }
-
-void Dongle::readBulkPackets(uint8_t endpoint)
-{
-    FixedBytes<USB_MAX_BULK_TRANSFER_SIZE> buffer;
-
-    while (!stopThreads)
-    {
-        int transferred = usbDevice->bulkRead(endpoint, buffer);
-
-        // Bulk read failed
-        if (transferred < 0)
-        {
-            break;
-        }
-
-        if (transferred > 0)
-        {
-            Bytes data = buffer.toBytes(transferred);
-
-            handleBulkData(data);
-        }
-    }
-}
@@ -24,8 +24,13 @@
 #include <cstdint>
 #include <array>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <map>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 // Microsoft's vendor ID
 #define DONGLE_VID 0x045e
@@ -37,9 +42,13 @@
 // Product ID for Microsoft Surface Book 2 built-in dongle
 #define DONGLE_PID_SURFACE 0x091e
 
+// Packets kept per WCID while a controller is being connected
+#define DONGLE_PENDING_PACKETS 16
+
 /*
  * Handles received 802.11 packets
  * Delegates GIP (Game Input Protocol) packets to controllers
+ * Controllers are connected and disconnected on a separate thread
  */
 class Dongle : public Mt76
 {
@@ -49,19 +58,62 @@ public:
 
     using Mt76::setPairingStatus;
 
+    void logStats();
+
 private:
+    enum LifecycleEventType
+    {
+        CONTROLLER_CONNECT,
+        CONTROLLER_DISCONNECT,
+    };
+
+    struct LifecycleEvent
+    {
+        LifecycleEventType type;
+        Bytes address;
+        uint8_t wcid;
+    };
+
+    /* Controller lifecycle */
+    void queueLifecycleEvent(LifecycleEvent event);
+    void processLifecycleEvents();
+    void connectController(const Bytes &address);
+    void disconnectController(uint8_t wcid);
+    bool publishController(
+        uint8_t wcid,
+        std::shared_ptr<Controller> controller
+    );
+
     /* Packet handling */
-    void handleControllerConnect(Bytes address);
+    void handleControllerConnect(ByteView address);
     void handleControllerDisconnect(uint8_t wcid);
-    void handleControllerPair(Bytes address, const Bytes &packet);
-    void handleControllerPacket(uint8_t wcid, const Bytes &packet);
-    void handleWlanPacket(const Bytes &packet);
-    void handleBulkData(const Bytes &data);
-    void readBulkPackets(uint8_t endpoint);
+    void handleControllerPair(ByteView address, ByteView packet);
+    void handleControllerPacket(uint8_t wcid, ByteView packet);
+    void queueControllerPacket(uint8_t wcid, ByteView data);
+    void handleWlanPacket(ByteView packet);
+    void handleBulkData(ByteView data);
+
+    // Slots are only accessed atomically
+    // Only changed by the lifecycle thread
+    std::array<std::shared_ptr<Controller>, MT_WCID_COUNT> controllers;
+
+    // Packets that might hold a reference to a controller
+    std::atomic<uint32_t> packetsInFlight;
+    std::mutex inFlightMutex;
+    std::condition_variable inFlightCondition;
+
+    // Packets that did not fit into a controller's queue
+    std::atomic<uint64_t> droppedPackets;
 
-    std::vector<std::thread> threads;
-    std::atomic<bool> stopThreads;
+    // Events are handled in the order they were received
+    std::thread lifecycleThread;
+    std::mutex lifecycleMutex;
+    std::condition_variable lifecycleCondition;
+    std::deque<LifecycleEvent> lifecycleEvents;
+    bool stopLifecycle = false;
 
-    std::mutex controllerMutex;
-    std::array<std::unique_ptr<Controller>, MT_WCID_COUNT> controllers;
+    // Packets for WCIDs without a controller while one is connecting
+    std::mutex pendingMutex;
+    bool connecting = false;
+    std::map<uint8_t, std::deque<Bytes>> pendingPackets;
 };
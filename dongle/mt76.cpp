@@ -19,11 +19,17 @@
 #include "mt76.h"
 #include "../utils/log.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 #define BITS_PER_LONG (sizeof(long) * 8)
 #define BIT(nr) (1UL << (nr))
+#define MT_ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 #define GENMASK(h, l) ((~0UL - (1UL << l) + 1) & (~0UL >> (BITS_PER_LONG - 1 - h)))
 
 /*
@@ -782,7 +788,21 @@
 /* The defines below belong to this project */
 
 // Poll timeout
+// Delay between register reads doubles up to the maximum
 #define MT_TIMEOUT_POLL std::chrono::seconds(1)
+#define MT_POLL_DELAY_MIN std::chrono::microseconds(50)
+#define MT_POLL_DELAY_MAX std::chrono::milliseconds(2)
+
+// EFUSE is read in blocks of 4 * 32 bits
+// Snapshot covers all calibration values in use
+#define MT_EFUSE_BLOCK_SIZE 0x10
+#define MT_EFUSE_SNAPSHOT_SIZE 0x100
+
+// Command response timeout
+#define MT_TIMEOUT_RESPONSE std::chrono::milliseconds(200)
+
+// Marks commands that could not be allocated or sent
+#define MT_SEQUENCE_INVALID 0xff
 
 // Power-on RF patch
 #define MT_RF_PATCH 0x0130
@@ -796,9 +816,26 @@
 #define MT_DMA_COMPLETE 0xc0000000
 #define MT_FW_LOAD_IVB 0x12
 
+// Reported by MT_FCE_DMA_ADDR once the firmware has started
+#define MT_FW_STARTED 0x01
+
 // Register offset in memory
 #define MT_REGISTER_OFFSET 0x410000
 
+// Shadow keys of the configuration space
+#define MT_SHADOW_CONFIG 0x10000
+
+// Registers only changed by the driver itself can be shadowed
+// Each one is keyed by the address space it is written to
+static const uint32_t shadowedRegisters[] = {
+    MT_XO_CTRL5 | MT_SHADOW_CONFIG,
+    MT_BEACON_TIME_CFG,
+};
+
+// Inband commands are limited to 192 bytes
+// Each random write takes an address and a value
+#define MT_RANDOM_WRITE_COUNT 24
+
 // Subgroups for channel power offsets
 #define MT_CH_2G_LOW 0x01
 #define MT_CH_2G_MID 0x02
@@ -810,10 +847,89 @@
 #define MT_CH_POWER_MIN 0x00
 #define MT_CH_POWER_MAX 0x2f
 
+// Optional aggregation of received packets into a single transfer
+// Timeout is given in units of 33 ns, limit in units of 1 KiB
+#define MT_RX_AGG_ENV "XOW_RX_AGGREGATION"
+#define MT_RX_AGG_TIMEOUT_ENV "XOW_RX_AGGREGATION_TIMEOUT"
+#define MT_RX_AGG_LIMIT_ENV "XOW_RX_AGGREGATION_LIMIT"
+#define MT_RX_AGG_TIMEOUT 0x80
+#define MT_RX_AGG_LIMIT 21
+
+// Last packet can exceed the aggregation limit
+#define MT_RX_AGG_BUFFER_SIZE USB_MAX_READ_SIZE
+#define MT_RX_AGG_LIMIT_MAX (MT_RX_AGG_BUFFER_SIZE / 1024 - 2)
+
 Mt76::Mt76(
     std::unique_ptr<UsbDevice> usbDevice
-) : usbDevice(std::move(usbDevice))
+) : usbDevice(std::move(usbDevice)),
+    connectedClients(0),
+    poller({ MT_POLL_DELAY_MIN, MT_POLL_DELAY_MAX, MT_TIMEOUT_POLL }),
+    dispatchThread(std::thread::id()),
+    batchThread(std::thread::id())
+{
+    dmaConfig = getDmaConfig();
+
+    // Command responses are needed during initialization
+    UsbDevice::Receive receive = std::bind(
+        &Mt76::dispatchBulkData,
+        this,
+        std::placeholders::_1
+    );
+    size_t size = dmaConfig.props.rxBulkAggEnabled
+        ? MT_RX_AGG_BUFFER_SIZE
+        : USB_MAX_BULK_TRANSFER_SIZE;
+
+    if (
+        !this->usbDevice->startRead(MT_EP_READ, receive, size) ||
+        !this->usbDevice->startRead(MT_EP_READ_PACKET, receive, size)
+    ) {
+        this->usbDevice->stopRead();
+
+        throw Mt76Exception("Failed to start reading");
+    }
+
+    try
+    {
+        initDevice();
+    }
+
+    catch (Mt76Exception &exception)
+    {
+        // Destructor is not called for partially constructed objects
+        this->usbDevice->stopRead();
+
+        throw;
+    }
+}
+
+Mt76::~Mt76()
+{
+    if (!setLedMode(MT_LED_OFF))
+    {
+        Log::error("Failed to turn off LED");
+    }
+
+    if (!powerMode(RADIO_OFF))
+    {
+        Log::error("Failed to turn off radio");
+    }
+
+    // Cancel outstanding reads
+    // Waits for data that is currently being dispatched
+    usbDevice->stopRead();
+}
+
+void Mt76::setPacketHandler(PacketHandler handler)
+{
+    std::lock_guard<std::mutex> lock(packetMutex);
+
+    packetHandler = handler;
+}
+
+void Mt76::initDevice()
 {
+    beginPhase("firmware");
+
     if (!loadFirmware())
     {
         throw Mt76Exception("Failed to load firmware");
@@ -822,19 +938,27 @@ Mt76::Mt76(
     // Select RX ring buffer 1
     // Turn radio on
     // Load BBP command register
-    if (
-        !selectFunction(Q_SELECT, 1) ||
-        !powerMode(RADIO_ON) ||
-        !loadCr(MT_RF_BBP_CR)
-    ) {
+    beginPhase("radio");
+    beginCommands();
+
+    bool radioEnabled = selectFunction(Q_SELECT, 1) &&
+        powerMode(RADIO_ON) &&
+        loadCr(MT_RF_BBP_CR);
+
+    if (!flushCommands() || !radioEnabled)
+    {
         throw Mt76Exception("Failed to init radio");
     }
 
+    beginPhase("registers");
+
     if (!initRegisters())
     {
         throw Mt76Exception("Failed to init registers");
     }
 
+    beginPhase("address");
+
     if (!sendFirmwareCommand(FW_MAC_ADDRESS_SET, macAddress))
     {
         throw Mt76Exception("Failed to set MAC address");
@@ -845,11 +969,15 @@ Mt76::Mt76(
     controlWrite(MT_RF_BYPASS_0, 0);
     controlWrite(MT_RF_SETTING_0, 0);
 
-    if (
-        !calibrate(MCU_CAL_TEMP_SENSOR, 0) ||
-        !calibrate(MCU_CAL_RXDCOC, 1) ||
-        !calibrate(MCU_CAL_RC, 0)
-    ) {
+    beginPhase("calibration");
+    beginCommands();
+
+    bool calibrated = calibrate(MCU_CAL_TEMP_SENSOR, 0) &&
+        calibrate(MCU_CAL_RXDCOC, 1) &&
+        calibrate(MCU_CAL_RC, 0);
+
+    if (!flushCommands() || !calibrated)
+    {
         throw Mt76Exception("Failed to calibrate chip");
     }
 
@@ -858,34 +986,63 @@ Mt76::Mt76(
         MT_MAC_SYS_CTRL_ENABLE_TX | MT_MAC_SYS_CTRL_ENABLE_RX
     );
 
+    beginPhase("channels");
+
     if (!initChannels())
     {
         throw Mt76Exception("Failed to init channels");
     }
 
+    beginPhase("beacon");
+
     if (!writeBeacon(false))
     {
         throw Mt76Exception("Failed to write beacon");
     }
+
+    startupProfile.end(usbDevice->getTransfers());
+
+    logStartup();
 }
 
-Mt76::~Mt76()
+void Mt76::beginPhase(std::string name)
 {
-    if (!setLedMode(MT_LED_OFF))
-    {
-        Log::error("Failed to turn off LED");
-    }
+    startupProfile.begin(name, usbDevice->getTransfers());
+}
 
-    if (!powerMode(RADIO_OFF))
+void Mt76::logStartup()
+{
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+
+    std::string name = "Dongle " + Log::formatBytes(macAddress);
+
+    Log::info(
+        "%s started in %lld us",
+        name.c_str(),
+        static_cast<long long>(duration_cast<microseconds>(
+            startupProfile.getTotal()
+        ).count())
+    );
+
+    for (const PhaseProfile::Phase &phase : startupProfile.getPhases())
     {
-        Log::error("Failed to turn off radio");
+        Log::info(
+            "%s startup phase %s: %lld us, %llu transfers",
+            name.c_str(),
+            phase.name.c_str(),
+            static_cast<long long>(
+                duration_cast<microseconds>(phase.duration).count()
+            ),
+            static_cast<unsigned long long>(phase.transfers)
+        );
     }
 }
 
 uint8_t Mt76::associateClient(Bytes address)
 {
     // Find first available WCID
-    uint16_t freeIds = static_cast<uint16_t>(~connectedClients);
+    uint16_t freeIds = static_cast<uint16_t>(~connectedClients.load());
     uint8_t wcid = __builtin_ffs(freeIds);
 
     if (wcid == 0)
@@ -895,7 +1052,7 @@ uint8_t Mt76::associateClient(Bytes address)
         return 0;
     }
 
-    connectedClients |= BIT(wcid - 1);
+    connectedClients.fetch_or(BIT(wcid - 1));
 
     TxWi txWi = {};
 
@@ -974,7 +1131,7 @@ bool Mt76::removeClient(uint8_t wcid)
     };
 
     // Remove WCID from connected clients
-    connectedClients &= ~BIT(wcid - 1);
+    connectedClients.fetch_and(static_cast<uint16_t>(~BIT(wcid - 1)));
 
     if (!sendFirmwareCommand(FW_CLIENT_REMOVE, wcidData))
     {
@@ -990,7 +1147,7 @@ bool Mt76::removeClient(uint8_t wcid)
         return false;
     }
 
-    if (connectedClients == 0 && !setLedMode(MT_LED_OFF))
+    if (connectedClients.load() == 0 && !setLedMode(MT_LED_OFF))
     {
         Log::error("Failed to set LED mode");
 
@@ -1049,7 +1206,7 @@ bool Mt76::sendClientPacket(
     const Bytes &packet
 ) {
     // Skip unconnected WCIDs
-    if ((connectedClients & BIT(wcid - 1)) == 0)
+    if ((connectedClients.load() & BIT(wcid - 1)) == 0)
     {
         return true;
     }
@@ -1126,6 +1283,93 @@ bool Mt76::setPairingStatus(bool enable)
     return true;
 }
 
+void Mt76::logStats()
+{
+    std::string name = "Dongle " + Log::formatBytes(macAddress);
+
+    usbDevice->logStats(name);
+
+    Log::info(
+        "%s register polls: %llu, reads: %llu, timeouts: %llu, waited: %llu us",
+        name.c_str(),
+        static_cast<unsigned long long>(poller.getPolls()),
+        static_cast<unsigned long long>(poller.getChecks()),
+        static_cast<unsigned long long>(poller.getTimeouts()),
+        static_cast<unsigned long long>(poller.getWaited())
+    );
+
+    logStartup();
+}
+
+void Mt76::dispatchBulkData(const PooledBytes &data)
+{
+    // Commands sent from this thread cannot wait for their responses
+    dispatchThread = std::this_thread::get_id();
+
+    ByteView frames(data.raw(), data.raw() + data.size());
+
+    if (!dmaConfig.props.rxBulkAggEnabled)
+    {
+        dispatchFrame(frames);
+
+        return;
+    }
+
+    // Each frame consists of its info, data and end marker
+    while (frames.size())
+    {
+        const RxInfoCommand *info = frames.toStruct<RxInfoCommand>();
+        size_t length = info
+            ? sizeof(RxInfoGeneric) + info->length + sizeof(uint32_t)
+            : 0;
+
+        if (!info || !info->length || length > frames.size())
+        {
+            Log::debug("Dropping %zu bytes of invalid frames", frames.size());
+
+            return;
+        }
+
+        dispatchFrame(ByteView(frames.begin(), frames.begin() + length));
+
+        frames = frames.skip(length);
+    }
+}
+
+void Mt76::dispatchFrame(ByteView data)
+{
+    if (data.size() >= sizeof(RxInfoCommand) + sizeof(uint32_t))
+    {
+        const RxInfoCommand *info = data.toStruct<RxInfoCommand>();
+        bool isResponse = info->port == CPU_RX_PORT && (
+            info->eventType == EVT_CMD_DONE ||
+            info->eventType == EVT_CMD_ERROR
+        );
+
+        if (isResponse)
+        {
+            // Skip packet end marker (4 bytes, identical to header)
+            completeCommand(
+                info->sequence,
+                info->eventType == EVT_CMD_ERROR,
+                data.skip(
+                    sizeof(RxInfoCommand),
+                    sizeof(uint32_t)
+                ).toBytes()
+            );
+
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(packetMutex);
+
+    if (packetHandler)
+    {
+        packetHandler(data);
+    }
+}
+
 bool Mt76::sendWlanPacket(const Bytes &data)
 {
     // Values must be 32-bit aligned
@@ -1185,56 +1429,74 @@ bool Mt76::initRegisters()
         MT_MAC_SYS_CTRL,
         MT_MAC_SYS_CTRL_ENABLE_TX | MT_MAC_SYS_CTRL_ENABLE_RX
     );
-    controlWrite(MT_AUTO_RSP_CFG, 0x13);
-    controlWrite(MT_MAX_LEN_CFG, 0x3e3fff);
-    controlWrite(MT_AMPDU_MAX_LEN_20M1S, 0xfffc9855);
-    controlWrite(MT_AMPDU_MAX_LEN_20M2S, 0xff);
-    controlWrite(MT_BKOFF_SLOT_CFG, 0x0109);
-    controlWrite(MT_PWR_PIN_CFG, 0);
-    controlWrite(MT_EDCA_CFG_AC(0), 0x064320);
-    controlWrite(MT_EDCA_CFG_AC(1), 0x0a4700);
-    controlWrite(MT_EDCA_CFG_AC(2), 0x043238);
-    controlWrite(MT_EDCA_CFG_AC(3), 0x03212f);
-    controlWrite(MT_TX_PIN_CFG, 0x150f0f);
-    controlWrite(MT_TX_SW_CFG0, 0x101001);
-    controlWrite(MT_TX_SW_CFG1, 0x010000);
-    controlWrite(MT_TXOP_CTRL_CFG, 0x10583f);
-    controlWrite(MT_TX_TIMEOUT_CFG, 0x0a0f90);
-    controlWrite(MT_TX_RETRY_CFG, 0x47d01f0f);
-    controlWrite(MT_CCK_PROT_CFG, 0x03f40003);
-    controlWrite(MT_OFDM_PROT_CFG, 0x03f40003);
-    controlWrite(MT_MM20_PROT_CFG, 0x01742004);
-    controlWrite(MT_GF20_PROT_CFG, 0x01742004);
-    controlWrite(MT_GF40_PROT_CFG, 0x03f42084);
-    controlWrite(MT_EXP_ACK_TIME, 0x2c00dc);
-    controlWrite(MT_TX_ALC_CFG_2, 0x22160a00);
-    controlWrite(MT_TX_ALC_CFG_3, 0x22160a76);
-    controlWrite(MT_TX_ALC_CFG_0, 0x3f3f1818);
-    controlWrite(MT_TX_ALC_CFG_4, 0x0606);
-    controlWrite(MT_PIFS_TX_CFG, 0x060fff);
-    controlWrite(MT_RX_FILTR_CFG, 0x017f17);
-    controlWrite(MT_LEGACY_BASIC_RATE, 0x017f);
-    controlWrite(MT_HT_BASIC_RATE, 0x8003);
-    controlWrite(MT_PN_PAD_MODE, 0x02);
-    controlWrite(MT_TXOP_HLDR_ET, 0x02);
-    controlWrite(MT_TX_PROT_CFG6, 0xe3f42004);
-    controlWrite(MT_TX_PROT_CFG7, 0xe3f42084);
-    controlWrite(MT_TX_PROT_CFG8, 0xe3f42104);
-    controlWrite(MT_DACCLK_EN_DLY_CFG, 0);
-    controlWrite(MT_RF_PA_MODE_ADJ0, 0xee000000);
-    controlWrite(MT_RF_PA_MODE_ADJ1, 0xee000000);
-    controlWrite(MT_TX0_RF_GAIN_CORR, 0x0f3c3c3c);
-    controlWrite(MT_TX1_RF_GAIN_CORR, 0x0f3c3c3c);
-    controlWrite(MT_PBF_CFG, 0x1efebcf5);
-    controlWrite(MT_PAUSE_ENABLE_CONTROL1, 0x0a);
-    controlWrite(MT_RF_BYPASS_0, 0x7f000000);
-    controlWrite(MT_RF_SETTING_0, 0x1a800000);
-    controlWrite(MT_XIFS_TIME_CFG, 0x33a40e0a);
-    controlWrite(MT_FCE_L2_STUFF, 0x03ff0223);
-    controlWrite(MT_TX_RTS_CFG, 0);
-    controlWrite(MT_BEACON_TIME_CFG, 0x0640);
-    controlWrite(MT_EXT_CCA_CFG, 0xf0e4);
-    controlWrite(MT_CH_TIME_CFG, 0x015f);
+    // MAC configuration is written by the MCU in batches
+    static const RegisterValue macRegisters[] = {
+        { MT_AUTO_RSP_CFG, 0x13 },
+        { MT_MAX_LEN_CFG, 0x3e3fff },
+        { MT_AMPDU_MAX_LEN_20M1S, 0xfffc9855 },
+        { MT_AMPDU_MAX_LEN_20M2S, 0xff },
+        { MT_BKOFF_SLOT_CFG, 0x0109 },
+        { MT_PWR_PIN_CFG, 0 },
+        { MT_EDCA_CFG_AC(0), 0x064320 },
+        { MT_EDCA_CFG_AC(1), 0x0a4700 },
+        { MT_EDCA_CFG_AC(2), 0x043238 },
+        { MT_EDCA_CFG_AC(3), 0x03212f },
+        { MT_TX_PIN_CFG, 0x150f0f },
+        { MT_TX_SW_CFG0, 0x101001 },
+        { MT_TX_SW_CFG1, 0x010000 },
+        { MT_TXOP_CTRL_CFG, 0x10583f },
+        { MT_TX_TIMEOUT_CFG, 0x0a0f90 },
+        { MT_TX_RETRY_CFG, 0x47d01f0f },
+        { MT_CCK_PROT_CFG, 0x03f40003 },
+        { MT_OFDM_PROT_CFG, 0x03f40003 },
+        { MT_MM20_PROT_CFG, 0x01742004 },
+        { MT_GF20_PROT_CFG, 0x01742004 },
+        { MT_GF40_PROT_CFG, 0x03f42084 },
+        { MT_EXP_ACK_TIME, 0x2c00dc },
+        { MT_TX_ALC_CFG_2, 0x22160a00 },
+        { MT_TX_ALC_CFG_3, 0x22160a76 },
+        { MT_TX_ALC_CFG_0, 0x3f3f1818 },
+        { MT_TX_ALC_CFG_4, 0x0606 },
+        { MT_PIFS_TX_CFG, 0x060fff },
+        { MT_RX_FILTR_CFG, 0x017f17 },
+        { MT_LEGACY_BASIC_RATE, 0x017f },
+        { MT_HT_BASIC_RATE, 0x8003 },
+        { MT_PN_PAD_MODE, 0x02 },
+        { MT_TXOP_HLDR_ET, 0x02 },
+        { MT_TX_PROT_CFG6, 0xe3f42004 },
+        { MT_TX_PROT_CFG7, 0xe3f42084 },
+        { MT_TX_PROT_CFG8, 0xe3f42104 },
+        { MT_DACCLK_EN_DLY_CFG, 0 },
+        { MT_RF_PA_MODE_ADJ0, 0xee000000 },
+        { MT_RF_PA_MODE_ADJ1, 0xee000000 },
+        { MT_TX0_RF_GAIN_CORR, 0x0f3c3c3c },
+        { MT_TX1_RF_GAIN_CORR, 0x0f3c3c3c },
+        { MT_PBF_CFG, 0x1efebcf5 },
+        { MT_PAUSE_ENABLE_CONTROL1, 0x0a },
+        { MT_RF_BYPASS_0, 0x7f000000 },
+        { MT_RF_SETTING_0, 0x1a800000 },
+        { MT_XIFS_TIME_CFG, 0x33a40e0a },
+        { MT_FCE_L2_STUFF, 0x03ff0223 },
+        { MT_TX_RTS_CFG, 0 },
+        { MT_BEACON_TIME_CFG, 0x0640 },
+        { MT_EXT_CCA_CFG, 0xf0e4 },
+        { MT_CH_TIME_CFG, 0x015f },
+    };
+
+    if (!randomWrite(macRegisters, MT_ARRAY_SIZE(macRegisters)))
+    {
+        Log::error("Failed to write MAC registers");
+
+        return false;
+    }
+
+    // Calibration data is read in one pass
+    if (!readEfuse())
+    {
+        Log::error("Failed to read EFUSE");
+
+        return false;
+    }
 
     // Calibrate internal crystal oscillator
     if (!calibrateCrystal())
@@ -1245,8 +1507,17 @@ bool Mt76::initRegisters()
     }
 
     // Configure automatic gain control (AGC)
-    controlWrite(MT_BBP(AGC, 8), 0x18365efa);
-    controlWrite(MT_BBP(AGC, 9), 0x18365efa);
+    static const RegisterValue agcRegisters[] = {
+        { MT_BBP(AGC, 8), 0x18365efa },
+        { MT_BBP(AGC, 9), 0x18365efa },
+    };
+
+    if (!randomWrite(agcRegisters, MT_ARRAY_SIZE(agcRegisters)))
+    {
+        Log::error("Failed to write AGC registers");
+
+        return false;
+    }
 
     macAddress = efuseRead(MT_EE_MAC_ADDR, 6);
 
@@ -1362,21 +1633,29 @@ bool Mt76::calibrateCrystal()
 
 bool Mt76::initChannels()
 {
-    // Configure each individual channel
     // Power for channels 0x24 - 0x30 gets increased by the original driver
     // It sometimes even exceeds the absolute maximum of 0x2f
-    configureChannel(0x01, MT_CH_BW_20, true);
-    configureChannel(0x06, MT_CH_BW_20, true);
-    configureChannel(0x0b, MT_CH_BW_20, true);
-    configureChannel(0x24, MT_CH_BW_40, true);
-    configureChannel(0x28, MT_CH_BW_40, false);
-    configureChannel(0x2c, MT_CH_BW_40, true);
-    configureChannel(0x30, MT_CH_BW_40, false);
-    configureChannel(0x95, MT_CH_BW_80, true);
-    configureChannel(0x99, MT_CH_BW_80, false);
-    configureChannel(0x9d, MT_CH_BW_80, true);
-    configureChannel(0xa1, MT_CH_BW_80, false);
-    configureChannel(0xa5, MT_CH_BW_80, false);
+    channels = {
+        getChannelConfig(0x01, MT_CH_BW_20, true),
+        getChannelConfig(0x06, MT_CH_BW_20, true),
+        getChannelConfig(0x0b, MT_CH_BW_20, true),
+        getChannelConfig(0x24, MT_CH_BW_40, true),
+        getChannelConfig(0x28, MT_CH_BW_40, false),
+        getChannelConfig(0x2c, MT_CH_BW_40, true),
+        getChannelConfig(0x30, MT_CH_BW_40, false),
+        getChannelConfig(0x95, MT_CH_BW_80, true),
+        getChannelConfig(0x99, MT_CH_BW_80, false),
+        getChannelConfig(0x9d, MT_CH_BW_80, true),
+        getChannelConfig(0xa1, MT_CH_BW_80, false),
+        getChannelConfig(0xa5, MT_CH_BW_80, false),
+    };
+
+    if (!configureChannels(channels))
+    {
+        Log::error("Failed to configure channels");
+
+        return false;
+    }
 
     // List of wireless channel candidates
     const Bytes candidates = {
@@ -1408,29 +1687,31 @@ bool Mt76::initChannels()
 
 bool Mt76::loadFirmware()
 {
-    std::ifstream file(FIRMWARE, std::ios::binary | std::ios::ate);
+    std::shared_ptr<const MappedFile> firmware = getFirmware();
 
-    if (!file)
+    if (!firmware)
     {
-        Log::error("Failed to open %s", FIRMWARE);
-        Log::info("Run xow-get-firmware.sh to download the firmware");
-
         return false;
     }
 
-    std::streampos fileSize = file.tellg();
-    Bytes firmware(fileSize);
+    // Lengths were validated when mapping the firmware
+    const FwHeader *header = firmware->toStruct<FwHeader>();
+    DmaConfig config = dmaConfig;
 
-    file.seekg(0, std::ios::beg);
+    uint32_t state = controlRead(MT_FCE_DMA_ADDR, MT_VEND_READ_CFG);
 
-    if (!file.read(reinterpret_cast<char*>(firmware.raw()), fileSize))
+    // Firmware keeps running while the dongle stays powered
+    if (state & MT_FW_STARTED)
     {
-        Log::error("Failed to read firmware");
+        // Commands are sent through bulk transfers
+        controlWrite(MT_USB_U3DMA_CFG, config.value, MT_VEND_WRITE_CFG);
 
-        return false;
+        Log::debug("Firmware already running, skipping upload");
+
+        return true;
     }
 
-    if (controlRead(MT_FCE_DMA_ADDR, MT_VEND_READ_CFG))
+    if (state)
     {
         Log::debug("Firmware already loaded, resetting...");
 
@@ -1443,7 +1724,7 @@ bool Mt76::loadFirmware()
         controlWrite(MT_FW_RESET_IVB, 0, MT_VEND_DEV_MODE);
 
         // Wait for firmware to reset
-        bool successful = pollTimeout([this] {
+        bool successful = poller.poll([this] {
             return controlRead(MT_FCE_DMA_ADDR, MT_VEND_READ_CFG) != 0x80000000;
         });
 
@@ -1455,11 +1736,6 @@ bool Mt76::loadFirmware()
         }
     }
 
-    DmaConfig config = {};
-
-    config.props.rxBulkEnabled = true;
-    config.props.txBulkEnabled = true;
-
     // Configure direct memory access (DMA)
     // Enable FCE and packet DMA
     controlWrite(MT_USB_U3DMA_CFG, config.value, MT_VEND_WRITE_CFG);
@@ -1470,10 +1746,9 @@ bool Mt76::loadFirmware()
     controlWrite(MT_FCE_PDMA_GLOBAL_CONF, 0x44);
     controlWrite(MT_FCE_SKIP_FS, 0x03);
 
-    const FwHeader *header = firmware.toStruct<FwHeader>();
-    Bytes::Iterator ilmStart = firmware.begin() + sizeof(FwHeader);
-    Bytes::Iterator dlmStart = ilmStart + header->ilmLength;
-    Bytes::Iterator dlmEnd = dlmStart + header->dlmLength;
+    const uint8_t *ilmStart = firmware->begin() + sizeof(FwHeader);
+    const uint8_t *dlmStart = ilmStart + header->ilmLength;
+    const uint8_t *dlmEnd = dlmStart + header->dlmLength;
 
     // Upload instruction local memory (ILM)
     if (!loadFirmwarePart(MT_MCU_ILM_OFFSET, ilmStart, dlmStart))
@@ -1496,8 +1771,8 @@ bool Mt76::loadFirmware()
     controlWrite(MT_FW_LOAD_IVB, 0, MT_VEND_DEV_MODE);
 
     // Wait for firmware to start
-    bool successful = pollTimeout([this] {
-        return controlRead(MT_FCE_DMA_ADDR, MT_VEND_READ_CFG) != 0x01;
+    bool successful = poller.poll([this] {
+        return controlRead(MT_FCE_DMA_ADDR, MT_VEND_READ_CFG) != MT_FW_STARTED;
     });
 
     if (!successful)
@@ -1512,45 +1787,111 @@ bool Mt76::loadFirmware()
     return true;
 }
 
+std::shared_ptr<const MappedFile> Mt76::getFirmware()
+{
+    // Firmware is shared by all dongles and kept until exiting
+    static std::mutex firmwareMutex;
+    static std::shared_ptr<const MappedFile> firmware;
+
+    std::lock_guard<std::mutex> lock(firmwareMutex);
+
+    if (firmware)
+    {
+        return firmware;
+    }
+
+    std::shared_ptr<const MappedFile> file;
+
+    try
+    {
+        file = std::make_shared<const MappedFile>(FIRMWARE);
+    }
+
+    catch (MappedFileException &exception)
+    {
+        Log::error("Failed to open %s: %s", FIRMWARE, exception.what());
+        Log::info("Run xow-get-firmware.sh to download the firmware");
+
+        return nullptr;
+    }
+
+    if (file->size() < sizeof(FwHeader))
+    {
+        Log::error("Firmware is too small");
+
+        return nullptr;
+    }
+
+    const FwHeader *header = file->toStruct<FwHeader>();
+    uint64_t length = static_cast<uint64_t>(header->ilmLength) +
+        header->dlmLength;
+
+    // Header must not point beyond the end of the file
+    if (length > file->size() - sizeof(FwHeader))
+    {
+        Log::error("Firmware header is invalid");
+
+        return nullptr;
+    }
+
+    firmware = file;
+
+    return firmware;
+}
+
 bool Mt76::loadFirmwarePart(
     uint32_t offset,
-    Bytes::Iterator start,
-    Bytes::Iterator end
+    const uint8_t *start,
+    const uint8_t *end
 ) {
-    // Send firmware in chunks
-    for (Bytes::Iterator chunk = start; chunk < end; chunk += MT_FW_CHUNK_SIZE)
-    {
-        uint32_t address = offset + chunk - start;
-        uint32_t remaining = end - chunk;
-        uint16_t length = remaining > MT_FW_CHUNK_SIZE
-            ? MT_FW_CHUNK_SIZE
-            : remaining;
+    // Next chunk is built while the previous one is being transferred
+    // The FCE only handles a single DMA transfer at a time
+    Bytes chunks[2];
+    size_t current = 0;
 
-        TxInfoCommand info = {};
-
-        info.port = CPU_TX_PORT;
-        info.infoType = NORMAL_PACKET;
-        info.length = length;
+    for (Bytes &chunk : chunks)
+    {
+        chunk.reserve(
+            sizeof(TxInfoCommand) + MT_FW_CHUNK_SIZE + sizeof(uint32_t)
+        );
+    }
 
-        Bytes out;
+    if (start < end)
+    {
+        buildFirmwareChunk(chunks[current], start, end);
+    }
 
-        out.append(info);
-        out.append(chunk, chunk + length);
-        out.pad(sizeof(uint32_t));
+    for (const uint8_t *chunk = start; chunk < end; chunk += MT_FW_CHUNK_SIZE)
+    {
+        uint32_t address = offset + chunk - start;
+        uint16_t length = chunks[current].size() -
+            sizeof(TxInfoCommand) - sizeof(uint32_t);
 
         controlWrite(MT_FCE_DMA_ADDR, address, MT_VEND_WRITE_CFG);
         controlWrite(MT_FCE_DMA_LEN, length << 16, MT_VEND_WRITE_CFG);
 
-        if (!usbDevice->bulkWrite(MT_EP_WRITE, out))
+        if (!usbDevice->bulkWrite(MT_EP_WRITE, chunks[current]))
         {
             Log::error("Failed to write firmware chunk");
 
             return false;
         }
 
+        current ^= 1;
+
+        // Overlaps with the DMA transfer of the previous chunk
+        if (end - chunk > MT_FW_CHUNK_SIZE)
+        {
+            buildFirmwareChunk(
+                chunks[current],
+                chunk + MT_FW_CHUNK_SIZE,
+                end
+            );
+        }
+
         uint32_t complete = (length << 16) | MT_DMA_COMPLETE;
 
-        bool successful = pollTimeout([this, complete] {
+        bool successful = poller.poll([this, complete] {
             return controlRead(MT_FCE_DMA_LEN, MT_VEND_READ_CFG) != complete;
         });
 
@@ -1565,6 +1906,29 @@ bool Mt76::loadFirmwarePart(
     return true;
 }
 
+void Mt76::buildFirmwareChunk(
+    Bytes &out,
+    const uint8_t *chunk,
+    const uint8_t *end
+) {
+    uint32_t remaining = end - chunk;
+    uint16_t length = remaining > MT_FW_CHUNK_SIZE
+        ? MT_FW_CHUNK_SIZE
+        : remaining;
+
+    TxInfoCommand info = {};
+
+    info.port = CPU_TX_PORT;
+    info.infoType = NORMAL_PACKET;
+    info.length = length;
+
+    // Keeps the previously reserved memory
+    out.clear();
+    out.append(info);
+    out.append(chunk, chunk + length);
+    out.pad(sizeof(uint32_t));
+}
+
 bool Mt76::writeBeacon(bool pairing)
 {
     const Bytes broadcastAddress = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
@@ -1619,7 +1983,7 @@ bool Mt76::writeBeacon(bool pairing)
     // Enable target beacon transmission time (TBTT) timer
     // Set TSF timer to AP mode
     // Activate beacon transmission
-    config.value = controlRead(MT_BEACON_TIME_CFG);
+    config.value = shadowRead(MT_BEACON_TIME_CFG);
     config.props.tsfTimerEnabled = true;
     config.props.tbttTimerEnabled = true;
     config.props.tsfSyncMode = 3;
@@ -1651,7 +2015,12 @@ bool Mt76::selectFunction(McuFunction function, uint32_t value)
     out.append(static_cast<uint32_t>(function));
     out.append(value);
 
-    if (!sendCommand(CMD_FUN_SET_OP, out))
+    // Queue selection is never acknowledged by the firmware
+    bool successful = function == Q_SELECT
+        ? sendCommand(CMD_FUN_SET_OP, out)
+        : executeCommand(CMD_FUN_SET_OP, out);
+
+    if (!successful)
     {
         Log::error("Failed to select function");
 
@@ -1667,7 +2036,7 @@ bool Mt76::powerMode(McuPowerMode mode)
 
     out.append(static_cast<uint32_t>(mode));
 
-    if (!sendCommand(CMD_POWER_SAVING_OP, out))
+    if (!executeCommand(CMD_POWER_SAVING_OP, out))
     {
         Log::error("Failed to set power mode");
 
@@ -1683,7 +2052,7 @@ bool Mt76::loadCr(McuCrMode mode)
 
     out.append(static_cast<uint32_t>(mode));
 
-    if (!sendCommand(CMD_LOAD_CR, out))
+    if (!executeCommand(CMD_LOAD_CR, out))
     {
         Log::error("Failed to load CR");
 
@@ -1702,7 +2071,7 @@ bool Mt76::burstWrite(uint32_t index, const Bytes &values)
     out.append(index);
     out.append(values);
 
-    if (!sendCommand(CMD_BURST_WRITE, out))
+    if (!executeCommand(CMD_BURST_WRITE, out))
     {
         Log::error("Failed to burst write register");
 
@@ -1712,6 +2081,66 @@ bool Mt76::burstWrite(uint32_t index, const Bytes &values)
     return true;
 }
 
+bool Mt76::randomWrite(const RegisterValue *registers, size_t count)
+{
+    std::vector<uint8_t> sequences;
+
+    // All chunks are in flight at the same time
+    for (size_t i = 0; i < count; i += MT_RANDOM_WRITE_COUNT)
+    {
+        size_t end = std::min<size_t>(i + MT_RANDOM_WRITE_COUNT, count);
+        uint8_t sequence = allocateSequence(CMD_RANDOM_WRITE, true);
+        Bytes out;
+
+        for (size_t j = i; j < end; j++)
+        {
+            out.append<uint32_t>(registers[j].address + MT_REGISTER_OFFSET);
+            out.append(registers[j].value);
+        }
+
+        if (
+            sequence != MT_SEQUENCE_INVALID &&
+            !postCommand(CMD_RANDOM_WRITE, out, sequence)
+        ) {
+            sequence = MT_SEQUENCE_INVALID;
+        }
+
+        sequences.push_back(sequence);
+    }
+
+    // Failed chunks are written after all preceding ones
+    for (size_t i = 0; i < sequences.size(); i++)
+    {
+        uint8_t sequence = sequences[i];
+
+        if (sequence != MT_SEQUENCE_INVALID && awaitCommand(sequence))
+        {
+            continue;
+        }
+
+        Log::debug("Random write failed, writing registers separately");
+
+        size_t start = i * MT_RANDOM_WRITE_COUNT;
+        size_t end = std::min<size_t>(start + MT_RANDOM_WRITE_COUNT, count);
+
+        for (size_t j = start; j < end; j++)
+        {
+            controlWrite(registers[j].address, registers[j].value);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        updateShadow(
+            registers[i].address,
+            MT_VEND_MULTI_WRITE,
+            registers[i].value
+        );
+    }
+
+    return true;
+}
+
 bool Mt76::calibrate(McuCalibration calibration, uint32_t value)
 {
     Bytes out;
@@ -1719,7 +2148,7 @@ bool Mt76::calibrate(McuCalibration calibration, uint32_t value)
     out.append(static_cast<uint32_t>(calibration));
     out.append(value);
 
-    if (!sendCommand(CMD_CALIBRATION_OP, out))
+    if (!executeCommand(CMD_CALIBRATION_OP, out))
     {
         Log::error("Failed to calibrate");
 
@@ -1729,7 +2158,7 @@ bool Mt76::calibrate(McuCalibration calibration, uint32_t value)
     return true;
 }
 
-bool Mt76::configureChannel(
+Mt76::ChannelConfigData Mt76::getChannelConfig(
     uint8_t channel,
     McuChannelBandwidth bandwidth,
     bool scan
@@ -1746,20 +2175,78 @@ bool Mt76::configureChannel(
     config.txPower = getChannelPower(channel);
     config.scan = scan;
 
+    Log::debug("Channel %d, power: %d", channel, config.txPower);
+
+    return config;
+}
+
+bool Mt76::configureChannels(const std::vector<ChannelConfigData> &configs)
+{
+    std::vector<uint8_t> sequences;
     Bytes out;
 
-    out.append(config);
+    // All channel switches are sent as a single transfer
+    // Every switch is acknowledged separately
+    for (const ChannelConfigData &config : configs)
+    {
+        uint8_t sequence = allocateSequence(CMD_SWITCH_CHANNEL_OP, true);
+        Bytes data;
 
-    if (!sendCommand(CMD_SWITCH_CHANNEL_OP, out))
+        if (sequence == MT_SEQUENCE_INVALID)
+        {
+            for (uint8_t allocated : sequences)
+            {
+                releaseSequence(allocated);
+            }
+
+            Log::error("Failed to switch channels");
+
+            return false;
+        }
+
+        data.append(config);
+        appendCommand(out, CMD_SWITCH_CHANNEL_OP, data, sequence);
+        sequences.push_back(sequence);
+    }
+
+    out.pad(sizeof(uint32_t));
+
+    // Failed writes terminate the device
+    if (!usbDevice->bulkWrite(MT_EP_WRITE, out))
     {
-        Log::error("Failed to switch channel");
+        for (uint8_t sequence : sequences)
+        {
+            releaseSequence(sequence);
+        }
+
+        Log::error("Failed to switch channels");
 
         return false;
     }
 
-    Log::debug("Channel %d, power: %d", channel, config.txPower);
+    bool successful = true;
 
-    return true;
+    // Lost responses do not affect the other switches
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        if (awaitCommand(sequences[i]))
+        {
+            continue;
+        }
+
+        Bytes data;
+
+        data.append(configs[i]);
+
+        if (!executeCommand(CMD_SWITCH_CHANNEL_OP, data))
+        {
+            Log::error("Failed to switch to channel %d", configs[i].channel);
+
+            successful = false;
+        }
+    }
+
+    return successful;
 }
 
 uint8_t Mt76::getChannelPower(uint8_t channel)
@@ -1783,7 +2270,7 @@ uint8_t Mt76::getChannelPower(uint8_t channel)
 
     if (entry.size() < 8)
     {
-        Log::error("Failed to read power table entry");
+        Log::error("Failed to read power table entry for channel %d", channel);
 
         return MT_CH_POWER_MIN;
     }
@@ -1958,39 +2445,391 @@ bool Mt76::setLedMode(uint32_t index)
     return true;
 }
 
-bool Mt76::sendCommand(McuCommand command, const Bytes &data)
-{
+void Mt76::appendCommand(
+    Bytes &out,
+    McuCommand command,
+    const Bytes &data,
+    uint8_t sequence
+) {
     // Values must be 32-bit aligned
-    // 32 zero-bits mark the end
     uint32_t length = data.size();
     uint8_t padding = Bytes::padding<uint32_t>(length);
 
-    // We ignore responses, sequence number is always zero
+    // Responses are only sent for non-zero sequence numbers
     TxInfoCommand info = {};
 
     info.port = CPU_TX_PORT;
     info.infoType = CMD_PACKET;
     info.command = command;
+    info.sequence = sequence;
     info.length = length + padding;
 
-    Bytes out;
-
     out.append(info);
     out.append(data);
     out.pad(padding);
+}
+
+bool Mt76::sendCommand(McuCommand command, const Bytes &data)
+{
+    return postCommand(command, data, 0);
+}
+
+bool Mt76::executeCommand(
+    McuCommand command,
+    const Bytes &data,
+    Bytes *response
+) {
+    std::thread::id thread = std::this_thread::get_id();
+
+    // Waiting on the dispatching thread would block the response
+    // Errors are logged once they are reported by the firmware
+    bool detached = thread == dispatchThread.load();
+    uint8_t sequence = allocateSequence(command, !detached);
+
+    if (sequence == MT_SEQUENCE_INVALID)
+    {
+        return false;
+    }
+
+    if (!postCommand(command, data, sequence))
+    {
+        return false;
+    }
+
+    if (detached)
+    {
+        return true;
+    }
+
+    // Batched commands are awaited when flushing
+    if (thread == batchThread.load())
+    {
+        batchSequences.push_back(sequence);
+
+        return true;
+    }
+
+    return awaitCommand(sequence, response);
+}
+
+bool Mt76::postCommand(
+    McuCommand command,
+    const Bytes &data,
+    uint8_t sequence
+) {
+    Bytes out;
+
+    appendCommand(out, command, data, sequence);
+
+    // 32 zero-bits mark the end
     out.pad(sizeof(uint32_t));
 
     if (!usbDevice->bulkWrite(MT_EP_WRITE, out))
     {
         Log::error("Failed to write command");
 
+        releaseSequence(sequence);
+
         return false;
     }
 
     return true;
 }
 
-Bytes Mt76::efuseRead(uint8_t address, uint8_t length)
+bool Mt76::awaitCommand(uint8_t sequence, Bytes *response)
+{
+    // Fire-and-forget commands are not tracked
+    if (!sequence)
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(commandMutex);
+    PendingCommand &pending = commands[sequence];
+
+    // Commands sent together share their deadline
+    bool completed = commandCondition.wait_until(
+        lock,
+        pending.sent + MT_TIMEOUT_RESPONSE,
+        [&pending] { return pending.completed; }
+    );
+
+    pending.active = false;
+    commandCondition.notify_all();
+
+    if (!completed)
+    {
+        Log::error("Command %d timed out", pending.command);
+
+        return false;
+    }
+
+    if (pending.failed)
+    {
+        Log::error("Command %d failed", pending.command);
+
+        return false;
+    }
+
+    if (response)
+    {
+        *response = std::move(pending.response);
+    }
+
+    return true;
+}
+
+void Mt76::completeCommand(uint8_t sequence, bool failed, Bytes data)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    PendingCommand &pending = commands[sequence];
+
+    // Responses to timed out commands are dropped
+    if (!sequence || !pending.active)
+    {
+        return;
+    }
+
+    if (!pending.awaited)
+    {
+        if (failed)
+        {
+            Log::error("Command %d failed", pending.command);
+        }
+
+        pending.active = false;
+        commandCondition.notify_all();
+
+        return;
+    }
+
+    pending.completed = true;
+    pending.failed = failed;
+    pending.response = std::move(data);
+
+    commandCondition.notify_all();
+}
+
+uint8_t Mt76::allocateSequence(McuCommand command, bool awaited)
+{
+    std::unique_lock<std::mutex> lock(commandMutex);
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline =
+        now + MT_TIMEOUT_RESPONSE;
+
+    while (true)
+    {
+        uint8_t sequence = findSequence(now);
+
+        if (sequence)
+        {
+            PendingCommand &pending = commands[sequence];
+
+            pending.active = true;
+            pending.awaited = awaited;
+            pending.completed = false;
+            pending.failed = false;
+            pending.command = command;
+            pending.sent = now;
+            pending.response.clear();
+
+            return sequence;
+        }
+
+        // Waiting on the dispatching thread would block the responses
+        if (!awaited || now >= deadline)
+        {
+            break;
+        }
+
+        // Detached commands expire by the deadline at the latest
+        commandCondition.wait_until(lock, deadline);
+
+        now = std::chrono::steady_clock::now();
+    }
+
+    Log::error("No free sequence number for command %d", command);
+
+    return MT_SEQUENCE_INVALID;
+}
+
+uint8_t Mt76::findSequence(std::chrono::steady_clock::time_point now)
+{
+    // Command lock is held by the caller
+    for (uint8_t i = 1; i < MT_SEQUENCE_COUNT; i++)
+    {
+        uint8_t sequence = nextSequence;
+        PendingCommand &pending = commands[sequence];
+
+        // Zero is reserved for commands without response
+        nextSequence = nextSequence % (MT_SEQUENCE_COUNT - 1) + 1;
+
+        // Responses to detached commands might never arrive
+        bool expired = !pending.awaited &&
+            now - pending.sent > MT_TIMEOUT_RESPONSE;
+
+        if (!pending.active || expired)
+        {
+            return sequence;
+        }
+    }
+
+    return 0;
+}
+
+void Mt76::releaseSequence(uint8_t sequence)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+
+    if (sequence)
+    {
+        commands[sequence].active = false;
+        commandCondition.notify_all();
+    }
+}
+
+void Mt76::beginCommands()
+{
+    batchThread = std::this_thread::get_id();
+}
+
+bool Mt76::flushCommands()
+{
+    bool successful = true;
+
+    batchThread = std::thread::id();
+
+    for (uint8_t sequence : batchSequences)
+    {
+        if (!awaitCommand(sequence))
+        {
+            successful = false;
+        }
+    }
+
+    batchSequences.clear();
+
+    return successful;
+}
+
+Mt76::DmaConfig Mt76::getDmaConfig()
+{
+    DmaConfig config = {};
+
+    config.props.rxBulkEnabled = true;
+    config.props.txBulkEnabled = true;
+
+    if (!std::getenv(MT_RX_AGG_ENV))
+    {
+        return config;
+    }
+
+    config.props.rxBulkAggEnabled = true;
+    config.props.rxBulkAggTimeout = getEnvValue(
+        MT_RX_AGG_TIMEOUT_ENV,
+        MT_RX_AGG_TIMEOUT,
+        0xff
+    );
+    config.props.rxBulkAggLimit = getEnvValue(
+        MT_RX_AGG_LIMIT_ENV,
+        MT_RX_AGG_LIMIT,
+        MT_RX_AGG_LIMIT_MAX
+    );
+
+    Log::info(
+        "RX aggregation enabled, timeout: %d, limit: %d KiB",
+        config.props.rxBulkAggTimeout,
+        config.props.rxBulkAggLimit
+    );
+
+    return config;
+}
+
+uint8_t Mt76::getEnvValue(const char *name, uint8_t fallback, uint8_t max)
+{
+    const char *value = std::getenv(name);
+
+    if (!value)
+    {
+        return fallback;
+    }
+
+    char *end = nullptr;
+    unsigned long number = std::strtoul(value, &end, 0);
+
+    if (end == value || *end || number == 0 || number > max)
+    {
+        Log::error("Invalid value for %s, using %d", name, fallback);
+
+        return fallback;
+    }
+
+    return number;
+}
+
+bool Mt76::readEfuse()
+{
+    Bytes block;
+
+    // First block contains the MAC address used as cache key
+    if (!readEfuseBlock(0, block))
+    {
+        return false;
+    }
+
+    std::string path = getEfuseCachePath(block);
+    std::ifstream file(path, std::ios::binary);
+    Bytes cached(MT_EFUSE_SNAPSHOT_SIZE);
+
+    bool valid = file.read(
+        reinterpret_cast<char*>(cached.raw()),
+        cached.size()
+    ) && std::equal(block.begin(), block.end(), cached.begin());
+
+    if (valid)
+    {
+        Log::debug("Using cached EFUSE from %s", path.c_str());
+
+        efuse = cached;
+
+        return true;
+    }
+
+    efuse = block;
+
+    for (
+        uint16_t address = MT_EFUSE_BLOCK_SIZE;
+        address < MT_EFUSE_SNAPSHOT_SIZE;
+        address += MT_EFUSE_BLOCK_SIZE
+    ) {
+        if (!readEfuseBlock(address, block))
+        {
+            return false;
+        }
+
+        efuse.append(block);
+    }
+
+    // Write to temporary file first to never leave partial caches
+    std::string temporary = path + ".tmp";
+    std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+
+    output.write(reinterpret_cast<const char*>(efuse.raw()), efuse.size());
+    output.close();
+
+    if (!output || std::rename(temporary.c_str(), path.c_str()))
+    {
+        // Caching is optional, the directory might not be writable
+        Log::debug("Failed to write EFUSE cache to %s", path.c_str());
+
+        std::remove(temporary.c_str());
+    }
+
+    return true;
+}
+
+bool Mt76::readEfuseBlock(uint16_t address, Bytes &data)
 {
     EfuseControl control = {};
 
@@ -1998,14 +2837,12 @@ Bytes Mt76::efuseRead(uint8_t address, uint8_t length)
     // Kick-off read
     control.value = controlRead(MT_EFUSE_CTRL);
     control.props.mode = MT_EE_READ;
-    control.props.addressIn = address & ~0x0f;
+    control.props.addressIn = address;
     control.props.kick = true;
 
     controlWrite(MT_EFUSE_CTRL, control.value);
 
-    Bytes data;
-
-    bool successful = pollTimeout([this] {
+    bool successful = poller.poll([this] {
         return controlRead(MT_EFUSE_CTRL) & MT_EFUSE_CTRL_KICK;
     });
 
@@ -2013,42 +2850,50 @@ Bytes Mt76::efuseRead(uint8_t address, uint8_t length)
     {
         Log::error("Read from EFUSE timed out");
 
-        return data;
+        return false;
     }
 
-    for (uint8_t i = 0; i < length; i += sizeof(uint32_t))
-    {
-        // Block data offset (multiple of 32 bits)
-        uint8_t offset = (address & 0x0c) + i;
-        uint32_t value = controlRead(MT_EFUSE_DATA_BASE + offset);
-        uint8_t remaining = length - i;
-        uint8_t size = remaining < sizeof(uint32_t)
-            ? remaining
-            : sizeof(uint32_t);
+    data.clear();
 
-        data.append(value, size);
+    for (uint8_t i = 0; i < MT_EFUSE_BLOCK_SIZE; i += sizeof(uint32_t))
+    {
+        data.append(controlRead(MT_EFUSE_DATA_BASE + i));
     }
 
-    return data;
+    return true;
 }
 
-bool Mt76::pollTimeout(std::function<bool()> condition)
+std::string Mt76::getEfuseCachePath(const Bytes &block)
 {
-    using Time = std::chrono::steady_clock::time_point;
+    char name[32] = {};
+
+    // Address is stored at the same position in every EFUSE
+    std::snprintf(
+        name,
+        sizeof(name),
+        "efuse-%02x%02x%02x%02x%02x%02x.bin",
+        block[MT_EE_MAC_ADDR],
+        block[MT_EE_MAC_ADDR + 1],
+        block[MT_EE_MAC_ADDR + 2],
+        block[MT_EE_MAC_ADDR + 3],
+        block[MT_EE_MAC_ADDR + 4],
+        block[MT_EE_MAC_ADDR + 5]
+    );
 
-    Time start = std::chrono::steady_clock::now();
+    return std::string(CACHE) + "/" + name;
+}
 
-    while (condition())
-    {
-        Time now = std::chrono::steady_clock::now();
+Bytes Mt76::efuseRead(uint8_t address, uint8_t length)
+{
+    // Reads start at 32-bit boundaries
+    size_t start = address & ~0x03;
 
-        if (now - start > MT_TIMEOUT_POLL)
-        {
-            return false;
-        }
+    if (start + length > efuse.size())
+    {
+        return Bytes();
     }
 
-    return true;
+    return Bytes(efuse, start, efuse.size() - start - length);
 }
 
 uint32_t Mt76::controlRead(uint16_t address, VendorRequest request)
@@ -2088,6 +2933,69 @@ void Mt76::controlWrite(
     }
 
     usbDevice->controlTransfer(packet, true);
+
+    updateShadow(address, request, value);
+}
+
+uint32_t Mt76::shadowRead(uint16_t address, VendorRequest request)
+{
+    std::unique_lock<std::mutex> lock(registerMutex);
+    uint32_t key = getShadowKey(address, request);
+    auto iterator = shadowRegisters.find(key);
+
+    if (iterator != shadowRegisters.end())
+    {
+        return iterator->second;
+    }
+
+    lock.unlock();
+
+    uint32_t value = controlRead(address, request);
+
+    updateShadow(address, request, value);
+
+    return value;
+}
+
+void Mt76::updateShadow(
+    uint16_t address,
+    VendorRequest request,
+    uint32_t value
+) {
+    std::lock_guard<std::mutex> lock(registerMutex);
+
+    // Device mode requests reset parts of the chip
+    if (request == MT_VEND_DEV_MODE)
+    {
+        shadowRegisters.clear();
+
+        return;
+    }
+
+    // FCE writes are not registers
+    if (request == MT_VEND_WRITE_FCE)
+    {
+        return;
+    }
+
+    const uint32_t *end = shadowedRegisters + MT_ARRAY_SIZE(shadowedRegisters);
+    uint32_t key = getShadowKey(address, request);
+
+    if (std::find(shadowedRegisters, end, key) == end)
+    {
+        return;
+    }
+
+    shadowRegisters[key] = value;
+}
+
+uint32_t Mt76::getShadowKey(uint16_t address, VendorRequest request)
+{
+    // Configuration space is separate from the MAC registers
+    bool config = request == MT_VEND_READ_CFG ||
+        request == MT_VEND_WRITE_CFG;
+
+    return address | (config ? MT_SHADOW_CONFIG : 0);
 }
 
 Mt76Exception::Mt76Exception(
@@ -19,10 +19,20 @@
 #pragma once
 
 #include "usb.h"
+#include "../utils/mapping.h"
+#include "../utils/poller.h"
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 
 // Endpoint numbers for reading and writing
 // WLAN packets use a separate endpoint
@@ -33,6 +43,9 @@
 // Maximum number of WCIDs
 #define MT_WCID_COUNT 16
 
+// Sequence numbers of MCU commands (4 bits)
+#define MT_SEQUENCE_COUNT 16
+
 // WLAN frame types
 #define MT_WLAN_MANAGEMENT 0x00
 #define MT_WLAN_DATA 0x02
@@ -505,9 +518,22 @@ protected:
         uint32_t value;
     };
 
+    struct RegisterValue
+    {
+        uint16_t address;
+        uint32_t value;
+    };
+
     Mt76(std::unique_ptr<UsbDevice> usbDevice);
     virtual ~Mt76();
 
+    // Frames stay valid until the handler returns
+    using PacketHandler = std::function<void(ByteView frame)>;
+
+    // Receives all frames except for command responses
+    // Waits for frames that are currently being handled
+    void setPacketHandler(PacketHandler handler);
+
     /* WLAN client operations */
     uint8_t associateClient(Bytes address);
     bool removeClient(uint8_t wcid);
@@ -521,23 +547,54 @@ protected:
     /* MCU functions/commands */
     bool setPairingStatus(bool enable);
 
+    /* Diagnostics */
+    void logStats();
+
     Bytes macAddress;
     std::unique_ptr<UsbDevice> usbDevice;
 
 private:
+    /*
+     * MCU command with a non-zero sequence number
+     * Detached commands are not awaited by their sender
+     */
+    struct PendingCommand
+    {
+        bool active = false;
+        bool awaited = false;
+        bool completed = false;
+        bool failed = false;
+        McuCommand command;
+        std::chrono::steady_clock::time_point sent;
+        Bytes response;
+    };
+
     /* Packet transmission */
     bool sendWlanPacket(const Bytes &packet);
 
+    /* Data reception */
+    void dispatchBulkData(const PooledBytes &data);
+    void dispatchFrame(ByteView data);
+
     /* Initialization routines */
+    void initDevice();
+    void beginPhase(std::string name);
+    void logStartup();
     bool initRegisters();
     bool calibrateCrystal();
     bool initChannels();
     bool loadFirmware();
     bool loadFirmwarePart(
         uint32_t offset,
-        Bytes::Iterator start,
-        Bytes::Iterator end
+        const uint8_t *start,
+        const uint8_t *end
+    );
+    void buildFirmwareChunk(
+        Bytes &out,
+        const uint8_t *chunk,
+        const uint8_t *end
     );
+    static std::shared_ptr<const MappedFile> getFirmware();
 
     /* MCU functions/commands */
     bool writeBeacon(bool pairing);
@@ -545,21 +602,45 @@ private:
     bool powerMode(McuPowerMode mode);
     bool loadCr(McuCrMode mode);
     bool burstWrite(uint32_t index, const Bytes &values);
+    bool randomWrite(const RegisterValue *registers, size_t count);
     bool calibrate(McuCalibration calibration, uint32_t value);
-    bool configureChannel(
+    ChannelConfigData getChannelConfig(
         uint8_t channel,
         McuChannelBandwidth bandwidth,
         bool scan
     );
+    bool configureChannels(const std::vector<ChannelConfigData> &configs);
     uint8_t getChannelPower(uint8_t channel);
     uint8_t getChannelGroup(uint8_t channel);
     uint8_t getChannelSubgroup(uint8_t channel);
     bool sendFirmwareCommand(McuFwCommand command, const Bytes &data);
     bool setLedMode(uint32_t index);
+    void appendCommand(
+        Bytes &out,
+        McuCommand command,
+        const Bytes &data,
+        uint8_t sequence
+    );
     bool sendCommand(McuCommand command, const Bytes &data);
+    bool executeCommand(
+        McuCommand command,
+        const Bytes &data,
+        Bytes *response = nullptr
+    );
+    bool postCommand(
+        McuCommand command,
+        const Bytes &data,
+        uint8_t sequence
+    );
+    bool awaitCommand(uint8_t sequence, Bytes *response = nullptr);
+    void completeCommand(uint8_t sequence, bool failed, Bytes data);
+    uint8_t allocateSequence(McuCommand command, bool awaited);
+    uint8_t findSequence(std::chrono::steady_clock::time_point now);
+    void releaseSequence(uint8_t sequence);
+    void beginCommands();
+    bool flushCommands();
 
     /* USB/MCU communication/utilities */
-    bool pollTimeout(std::function<bool()> condition);
     uint32_t controlRead(
         uint16_t address,
         VendorRequest request = MT_VEND_MULTI_READ
@@ -569,9 +650,60 @@ private:
         uint32_t value,
         VendorRequest request = MT_VEND_MULTI_WRITE
     );
-    Bytes efuseRead(uint8_t address, uint8_t index);
+    uint32_t shadowRead(
+        uint16_t address,
+        VendorRequest request = MT_VEND_MULTI_READ
+    );
+    void updateShadow(
+        uint16_t address,
+        VendorRequest request,
+        uint32_t value
+    );
+    static uint32_t getShadowKey(uint16_t address, VendorRequest request);
+    DmaConfig getDmaConfig();
+    static uint8_t getEnvValue(const char *name, uint8_t fallback, uint8_t max);
+    bool readEfuse();
+    bool readEfuseBlock(uint16_t address, Bytes &data);
+    std::string getEfuseCachePath(const Bytes &block);
+    Bytes efuseRead(uint8_t address, uint8_t length);
+
+    // Written by the lifecycle thread, read when sending packets
+    std::atomic<uint16_t> connectedClients;
+
+    // Waits for register changes
+    Poller poller;
+
+    // Time spent in each step of the initialization
+    PhaseProfile startupProfile;
+
+    // Snapshot of the calibration data
+    Bytes efuse;
+
+    // Last values written to registers owned by the driver
+    std::mutex registerMutex;
+    std::map<uint32_t, uint32_t> shadowRegisters;
+
+    // Precomputed channel configuration
+    std::vector<ChannelConfigData> channels;
+
+    std::mutex packetMutex;
+    PacketHandler packetHandler;
+
+    // Applies to received frames as well
+    DmaConfig dmaConfig;
+
+    // Commands waiting for their response, indexed by sequence number
+    std::mutex commandMutex;
+    std::condition_variable commandCondition;
+    PendingCommand commands[MT_SEQUENCE_COUNT];
+    uint8_t nextSequence = 1;
+
+    // Thread that handles received data
+    std::atomic<std::thread::id> dispatchThread;
 
-    uint16_t connectedClients = 0;
+    // Commands of the batch are awaited together
+    std::atomic<std::thread::id> batchThread;
+    std::vector<uint8_t> batchSequences;
 };
 
 class Mt76Exception : public std::runtime_error
@@ -19,14 +19,109 @@
 #include "usb.h"
 #include "../utils/log.h"
 
+#include <algorithm>
+
 // Timeouts in milliseconds
-#define USB_TIMEOUT_READ 1000
+// Reads never time out, they get cancelled instead
 #define USB_TIMEOUT_WRITE 1000
+#define USB_TIMEOUT_CANCEL 1000
+
+// Failing devices are reopened a limited number of times
+// The counter is reset once a device runs long enough
+#define USB_MAX_RECOVERIES 3
+#define USB_RECOVERY_WINDOW std::chrono::seconds(10)
+
+using Clock = LatencyHistogram::Clock;
+
+const TransferStats& UsbDevice::getStats(uint8_t endpoint) const
+{
+    return stats[(endpoint & 0x0f) | ((endpoint & 0x80) >> 3)];
+}
+
+uint64_t UsbDevice::getTransfers() const
+{
+    uint64_t transfers = 0;
 
-UsbDevice::UsbDevice(
+    // Failed transfers took time as well
+    for (const TransferStats &endpoint : stats)
+    {
+        transfers += endpoint.transfers + endpoint.timeouts + endpoint.errors;
+    }
+
+    return transfers;
+}
+
+void UsbDevice::logStats(const std::string &name) const
+{
+    for (uint8_t i = 0; i < USB_ENDPOINT_COUNT; i++)
+    {
+        const TransferStats &endpoint = stats[i];
+
+        if (endpoint.empty())
+        {
+            continue;
+        }
+
+        // Restore direction bit of endpoint address
+        uint8_t address = (i & 0x0f) | ((i & 0x10) << 3);
+
+        Log::info(
+            "%s endpoint 0x%02x: %llu transfers, %llu bytes, "
+            "%llu timeouts, %llu errors",
+            name.c_str(),
+            address,
+            static_cast<unsigned long long>(endpoint.transfers.load()),
+            static_cast<unsigned long long>(endpoint.bytes.load()),
+            static_cast<unsigned long long>(endpoint.timeouts.load()),
+            static_cast<unsigned long long>(endpoint.errors.load())
+        );
+        Log::info(
+            "%s endpoint 0x%02x: %llu retries, %llu cleared halts",
+            name.c_str(),
+            address,
+            static_cast<unsigned long long>(endpoint.retries.load()),
+            static_cast<unsigned long long>(endpoint.clearedHalts.load())
+        );
+
+        if (!(address & LIBUSB_ENDPOINT_IN))
+        {
+            Log::info(
+                "%s endpoint 0x%02x latency: %s",
+                name.c_str(),
+                address,
+                endpoint.latency.format().c_str()
+            );
+        }
+
+        else
+        {
+            Log::info(
+                "%s endpoint 0x%02x arrival interval: %s",
+                name.c_str(),
+                address,
+                endpoint.interval.format().c_str()
+            );
+            Log::info(
+                "%s endpoint 0x%02x processing: %s",
+                name.c_str(),
+                address,
+                endpoint.processing.format().c_str()
+            );
+        }
+    }
+}
+
+TransferStats& UsbDevice::endpointStats(uint8_t endpoint)
+{
+    return stats[(endpoint & 0x0f) | ((endpoint & 0x80) >> 3)];
+}
+
+LibusbDevice::LibusbDevice(
     libusb_device *device,
-    Terminate terminate
-) : terminate(terminate)
+    UsbDeviceManager &manager,
+    Terminate terminate,
+    RecoveryPolicy policy
+) : manager(manager), terminate(terminate), policy(policy), failed(false)
 {
     Log::debug("Opening device...");
 
@@ -57,12 +152,32 @@ UsbDevice::UsbDevice(
     {
         throw UsbException("Error claiming interface", error);
     }
+
+    writeMemory.reset(new DeviceMemory(handle, USB_WRITE_BUFFER_SIZE));
+
+    // Writes from heap memory need no staging
+    if (!writeMemory->isMapped())
+    {
+        writeMemory.reset();
+    }
+
+    manager.addDevice(this);
 }
 
-UsbDevice::~UsbDevice()
+LibusbDevice::~LibusbDevice()
 {
     Log::debug("Closing device...");
 
+    manager.removeDevice(this);
+
+    for (auto &entry : readers)
+    {
+        closeReader(*entry.second);
+    }
+
+    // Device memory has to be freed before closing the handle
+    readers.clear();
+
     int error = libusb_release_interface(handle, 0);
 
     if (error)
@@ -73,87 +188,678 @@ UsbDevice::~UsbDevice()
         );
     }
 
+    writeMemory.reset();
     libusb_close(handle);
 }
 
-void UsbDevice::controlTransfer(ControlPacket packet, bool write)
+void LibusbDevice::controlTransfer(ControlPacket packet, bool write)
 {
-    uint8_t direction = write ? LIBUSB_ENDPOINT_OUT : LIBUSB_ENDPOINT_IN;
+    // Fail fast once the device is being shut down
+    if (failed)
+    {
+        return;
+    }
 
-    // Number of bytes or error code
-    int transferred = libusb_control_transfer(
-        handle,
-        LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE | direction,
-        packet.request,
-        packet.value,
-        packet.index,
-        packet.data,
-        packet.length,
-        USB_TIMEOUT_WRITE
-    );
+    uint8_t direction = write ? LIBUSB_ENDPOINT_OUT : LIBUSB_ENDPOINT_IN;
+    TransferStats &stats = endpointStats(0);
+    Recovery recovery;
 
-    if (transferred != packet.length)
+    while (true)
     {
-        Log::error(
-            "Error in control transfer: %s",
-            libusb_error_name(transferred)
+        Clock::time_point start = Clock::now();
+
+        // Number of bytes or error code
+        int transferred = libusb_control_transfer(
+            handle,
+            LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE | direction,
+            packet.request,
+            packet.value,
+            packet.index,
+            packet.data,
+            packet.length,
+            USB_TIMEOUT_WRITE
         );
 
-        terminate();
+        if (transferred == packet.length)
+        {
+            stats.recordTransfer(transferred, Clock::now() - start);
+
+            return;
+        }
+
+        // Short transfers are treated like I/O errors
+        int error = transferred < 0 ? transferred : LIBUSB_ERROR_IO;
+
+        if (error == LIBUSB_ERROR_TIMEOUT)
+        {
+            stats.recordTimeout();
+        }
+
+        else
+        {
+            stats.recordError();
+        }
+
+        if (!recover(0, error, recovery))
+        {
+            Log::error(
+                "Error in control transfer: %s",
+                libusb_error_name(error)
+            );
+
+            fail();
+
+            return;
+        }
+
+        std::this_thread::sleep_until(recovery.retryTime);
     }
 }
 
-int UsbDevice::bulkRead(
+bool LibusbDevice::startRead(
     uint8_t endpoint,
-    FixedBytes<USB_MAX_BULK_TRANSFER_SIZE> &buffer
+    Receive receive,
+    size_t size
 ) {
-    int transferred = 0;
-    int error = libusb_bulk_transfer(
-        handle,
-        endpoint | LIBUSB_ENDPOINT_IN,
-        buffer.raw(),
-        buffer.size(),
-        &transferred,
-        USB_TIMEOUT_READ
-    );
+    if (size == 0 || size > USB_MAX_READ_SIZE)
+    {
+        Log::error("Invalid read buffer size: %zu", size);
+
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(readerMutex);
+    std::unique_ptr<BulkReader> &reader = readers[endpoint];
+
+    if (reader)
+    {
+        Log::error("Endpoint is already being read");
+
+        return false;
+    }
 
-    if (error && error != LIBUSB_ERROR_TIMEOUT)
+    reader.reset(new BulkReader(handle, size));
+    reader->device = this;
+    reader->endpoint = endpoint | LIBUSB_ENDPOINT_IN;
+    reader->receive = receive;
+    reader->stats = &endpointStats(reader->endpoint);
+    reader->packets.resize(USB_READ_BUFFERS);
+    reader->packetTimes.resize(USB_READ_BUFFERS);
+    reader->transfers.resize(USB_READ_TRANSFERS);
+
+    BulkReader *starving = reader.get();
+
+    // Starved transfers are resumed by the event thread
+    reader->pool.setReleaseHandler([starving] {
+        if (starving->starved)
+        {
+            starving->device->manager.wakeEventThread();
+        }
+    });
+
+    std::unique_lock<std::mutex> readerLock(reader->mutex);
+
+    for (ReadTransfer &transfer : reader->transfers)
     {
-        Log::error("Error in bulk read: %s", libusb_error_name(error));
+        transfer.reader = reader.get();
+        transfer.transfer = libusb_alloc_transfer(0);
+        transfer.buffer = reader->pool.get();
+        transfer.idle = true;
+
+        if (!transfer.transfer)
+        {
+            Log::error("Error allocating transfer");
+
+            readerLock.unlock();
+            cancelReader(*reader);
+
+            return false;
+        }
+
+        libusb_fill_bulk_transfer(
+            transfer.transfer,
+            handle,
+            reader->endpoint,
+            transfer.buffer.raw(),
+            transfer.buffer.capacity(),
+            readCallback,
+            &transfer,
+            0
+        );
+
+        int error = libusb_submit_transfer(transfer.transfer);
 
-        terminate();
+        if (error)
+        {
+            Log::error(
+                "Error submitting transfer: %s",
+                libusb_error_name(error)
+            );
 
-        return -1;
+            readerLock.unlock();
+            cancelReader(*reader);
+
+            return false;
+        }
+
+        transfer.idle = false;
+        reader->pending++;
     }
 
-    return transferred;
+    return true;
 }
 
-bool UsbDevice::bulkWrite(uint8_t endpoint, Bytes &data)
+void LibusbDevice::stopRead()
 {
-    int transferred = 0;
-    int error = libusb_bulk_transfer(
-        handle,
-        endpoint | LIBUSB_ENDPOINT_OUT,
-        data.raw(),
-        data.size(),
-        &transferred,
-        USB_TIMEOUT_WRITE
-    );
+    std::unique_lock<std::mutex> lock(readerMutex, std::defer_lock);
+
+    // Receive handlers already hold the lock on the event thread
+    // Their reader stops dispatching once the handler returns
+    if (!manager.isEventThread())
+    {
+        // Waits for data that is currently being dispatched
+        lock.lock();
+    }
+
+    for (auto &entry : readers)
+    {
+        cancelReader(*entry.second);
+    }
+}
+
+bool LibusbDevice::bulkWrite(uint8_t endpoint, Bytes &data)
+{
+    if (failed)
+    {
+        return false;
+    }
+
+    endpoint |= LIBUSB_ENDPOINT_OUT;
+
+    TransferStats &stats = endpointStats(endpoint);
+    std::unique_lock<std::mutex> lock(writeMutex, std::defer_lock);
+    uint8_t *buffer = data.raw();
+    Recovery recovery;
+
+    // Kernel uses device memory directly instead of copying it
+    if (writeMemory && data.size() <= writeMemory->size())
+    {
+        lock.lock();
+        std::copy(data.begin(), data.end(), writeMemory->raw());
+
+        buffer = writeMemory->raw();
+    }
+
+    while (true)
+    {
+        Clock::time_point start = Clock::now();
+        int transferred = 0;
+        int error = libusb_bulk_transfer(
+            handle,
+            endpoint,
+            buffer,
+            data.size(),
+            &transferred,
+            USB_TIMEOUT_WRITE
+        );
+
+        if (!error)
+        {
+            stats.recordTransfer(transferred, Clock::now() - start);
+
+            return true;
+        }
+
+        if (error == LIBUSB_ERROR_TIMEOUT)
+        {
+            stats.recordTimeout();
+        }
+
+        else
+        {
+            stats.recordError();
+        }
+
+        // Resending a partially written buffer would corrupt the stream
+        if (transferred > 0 || !recover(endpoint, error, recovery))
+        {
+            Log::error("Error in bulk write: %s", libusb_error_name(error));
+
+            fail();
+
+            return false;
+        }
+
+        std::this_thread::sleep_until(recovery.retryTime);
+    }
+}
+
+LibusbDevice::DeviceMemory::DeviceMemory(
+    libusb_device_handle *handle,
+    size_t size
+) : handle(handle), length(size), mapped(true)
+{
+    data = libusb_dev_mem_alloc(handle, size);
+
+    if (!data)
+    {
+        Log::debug("Device memory unavailable, using heap");
+
+        data = new uint8_t[size];
+        mapped = false;
+    }
+}
+
+LibusbDevice::DeviceMemory::~DeviceMemory()
+{
+    if (!mapped)
+    {
+        delete[] data;
+
+        return;
+    }
+
+    int error = libusb_dev_mem_free(handle, data, length);
 
     if (error)
     {
-        Log::error("Error in bulk write: %s", libusb_error_name(error));
+        Log::error(
+            "Error freeing device memory: %s",
+            libusb_error_name(error)
+        );
+    }
+}
+
+Clock::time_point LibusbDevice::dispatchReads()
+{
+    std::lock_guard<std::mutex> lock(readerMutex);
+    Clock::time_point deadline = Clock::time_point::max();
+
+    for (auto &entry : readers)
+    {
+        BulkReader &reader = *entry.second;
+
+        // Errors can occur on any thread, cancellation happens here
+        if (failed)
+        {
+            cancelReader(reader);
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> readerLock(reader.mutex);
+
+        // Handlers are called outside of libusb's callbacks
+        // They are allowed to perform synchronous transfers
+        while (reader.packetCount > 0 && !reader.stopping)
+        {
+            PooledBytes data = std::move(reader.packets[reader.packetStart]);
+            Clock::time_point completed = reader.packetTimes[reader.packetStart];
 
-        terminate();
+            reader.packetStart = (reader.packetStart + 1) % USB_READ_BUFFERS;
+            reader.packetCount--;
+
+            // Reader is working again
+            reader.recovery = Recovery();
+
+            readerLock.unlock();
+            reader.receive(data);
+            reader.stats->processing.record(Clock::now() - completed);
+            readerLock.lock();
+        }
 
+        if (reader.starved && !reader.error && !reader.stopping)
+        {
+            resumeReader(reader);
+        }
+
+        if (reader.error && !reader.stopping)
+        {
+            readerLock.unlock();
+            deadline = std::min(deadline, recoverReader(reader));
+        }
+    }
+
+    return deadline;
+}
+
+void LibusbDevice::resumeReader(BulkReader &reader)
+{
+    bool starved = false;
+
+    // Reader's mutex is held by the caller
+    for (ReadTransfer &transfer : reader.transfers)
+    {
+        if (!transfer.idle || transfer.buffer)
+        {
+            continue;
+        }
+
+        transfer.buffer = reader.pool.get();
+
+        if (!transfer.buffer)
+        {
+            starved = true;
+
+            break;
+        }
+
+        transfer.transfer->buffer = transfer.buffer.raw();
+
+        // Failed submissions are handled by the recovery
+        reader.error = libusb_submit_transfer(transfer.transfer);
+
+        if (reader.error)
+        {
+            break;
+        }
+
+        transfer.idle = false;
+        reader.pending++;
+    }
+
+    reader.starved = starved;
+}
+
+Clock::time_point LibusbDevice::recoverReader(BulkReader &reader)
+{
+    std::unique_lock<std::mutex> lock(reader.mutex);
+    int error = reader.error;
+
+    lock.unlock();
+
+    if (!reader.retryScheduled)
+    {
+        if (!recover(reader.endpoint, error, reader.recovery))
+        {
+            Log::error("Error in bulk read: %s", libusb_error_name(error));
+
+            fail();
+
+            return Clock::time_point::max();
+        }
+
+        reader.retryScheduled = true;
+    }
+
+    // Event thread keeps dispatching other readers during the backoff
+    if (Clock::now() < reader.recovery.retryTime)
+    {
+        return reader.recovery.retryTime;
+    }
+
+    reader.retryScheduled = false;
+
+    lock.lock();
+
+    if (reader.stopping)
+    {
+        return Clock::time_point::max();
+    }
+
+    reader.error = 0;
+
+    for (ReadTransfer &transfer : reader.transfers)
+    {
+        // Transfers without buffer are resumed once one is released
+        if (!transfer.idle || !transfer.buffer)
+        {
+            continue;
+        }
+
+        reader.error = libusb_submit_transfer(transfer.transfer);
+
+        if (reader.error)
+        {
+            break;
+        }
+
+        transfer.idle = false;
+        reader.pending++;
+    }
+
+    // Failed submissions are recovered during the following dispatch
+    return reader.error ? Clock::now() : Clock::time_point::max();
+}
+
+bool LibusbDevice::recover(uint8_t endpoint, int error, Recovery &recovery)
+{
+    TransferStats &stats = endpointStats(endpoint);
+
+    // Nothing left to recover
+    if (failed || error == LIBUSB_ERROR_NO_DEVICE)
+    {
         return false;
     }
 
-    return true;
+    // Callers wait for the retry time before resubmitting
+    if (recovery.retries < policy.retries)
+    {
+        recovery.retryTime = Clock::now() +
+            policy.backoff * (1 << recovery.retries);
+
+        recovery.retries++;
+        stats.recordRetry();
+
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(recoveryMutex);
+
+    // Control endpoint clears its halt condition by itself
+    if (
+        policy.clearHalt &&
+        !recovery.clearedHalt &&
+        error == LIBUSB_ERROR_PIPE &&
+        (endpoint & 0x0f)
+    ) {
+        Log::info("Clearing halt on endpoint 0x%02x", endpoint);
+
+        recovery.clearedHalt = true;
+        stats.recordClearHalt();
+
+        int result = libusb_clear_halt(handle, endpoint);
+
+        if (!result)
+        {
+            recovery.retryTime = Clock::now();
+
+            return true;
+        }
+
+        Log::error("Error clearing halt: %s", libusb_error_name(result));
+    }
+
+    return false;
 }
 
-UsbDeviceManager::UsbDeviceManager()
+void LibusbDevice::cancelReader(BulkReader &reader)
+{
+    std::lock_guard<std::mutex> lock(reader.mutex);
+
+    if (reader.stopping)
+    {
+        return;
+    }
+
+    reader.stopping = true;
+
+    for (ReadTransfer &transfer : reader.transfers)
+    {
+        // Transfer might have completed already
+        if (transfer.transfer)
+        {
+            libusb_cancel_transfer(transfer.transfer);
+        }
+    }
+}
+
+void LibusbDevice::closeReader(BulkReader &reader)
+{
+    cancelReader(reader);
+
+    std::unique_lock<std::mutex> lock(reader.mutex);
+
+    // Cancelled transfers complete on the event thread
+    // Their memory must not be freed before that
+    while (true)
+    {
+        bool cancelled = reader.cancelCondition.wait_for(
+            lock,
+            std::chrono::milliseconds(USB_TIMEOUT_CANCEL),
+            [&reader] { return reader.pending == 0; }
+        );
+
+        if (cancelled)
+        {
+            break;
+        }
+
+        Log::error("Cancelling transfers timed out, still waiting");
+    }
+
+    for (ReadTransfer &transfer : reader.transfers)
+    {
+        libusb_free_transfer(transfer.transfer);
+    }
+
+    // Return all buffers to the pool
+    reader.transfers.clear();
+    reader.packets.clear();
+}
+
+void LibusbDevice::fail()
+{
+    // Only the first error terminates the device
+    if (failed.exchange(true))
+    {
+        return;
+    }
+
+    // Event thread cancels outstanding reads
+    manager.wakeEventThread();
+
+    terminate();
+}
+
+void LibusbDevice::readCallback(libusb_transfer *transfer)
+{
+    ReadTransfer *readTransfer = static_cast<ReadTransfer*>(
+        transfer->user_data
+    );
+    BulkReader *reader = readTransfer->reader;
+    std::unique_lock<std::mutex> lock(reader->mutex);
+
+    libusb_transfer_status status = transfer->status;
+
+    if (reader->stopping)
+    {
+        if (--reader->pending == 0)
+        {
+            reader->cancelCondition.notify_all();
+        }
+
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+
+    if (status == LIBUSB_TRANSFER_COMPLETED)
+    {
+        reader->stats->recordTransfer(transfer->actual_length);
+
+        if (reader->lastArrival != Clock::time_point())
+        {
+            reader->stats->interval.record(now - reader->lastArrival);
+        }
+
+        reader->lastArrival = now;
+    }
+
+    else if (status == LIBUSB_TRANSFER_TIMED_OUT)
+    {
+        reader->stats->recordTimeout();
+    }
+
+    else
+    {
+        reader->stats->recordError();
+    }
+
+    if (status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length > 0)
+    {
+        // Ring holds at most as many packets as the pool has buffers
+        size_t end = (reader->packetStart + reader->packetCount) %
+            USB_READ_BUFFERS;
+        PooledBytes &packet = reader->packets[end];
+
+        reader->packetTimes[end] = now;
+        packet = std::move(readTransfer->buffer);
+        packet.resize(transfer->actual_length);
+        reader->packetCount++;
+
+        readTransfer->buffer = reader->pool.get();
+
+        // Transfer waits until received data has been released
+        if (!readTransfer->buffer)
+        {
+            readTransfer->idle = true;
+            reader->starved = true;
+            reader->pending--;
+            reader->cancelCondition.notify_all();
+            lock.unlock();
+
+            reader->device->manager.wakeEventThread();
+
+            return;
+        }
+
+        transfer->buffer = readTransfer->buffer.raw();
+    }
+
+    // Map transfer status to libusb error code
+    switch (status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            break;
+
+        case LIBUSB_TRANSFER_STALL:
+            reader->error = LIBUSB_ERROR_PIPE;
+            break;
+
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            reader->error = LIBUSB_ERROR_NO_DEVICE;
+            break;
+
+        case LIBUSB_TRANSFER_OVERFLOW:
+            reader->error = LIBUSB_ERROR_OVERFLOW;
+            break;
+
+        default:
+            reader->error = LIBUSB_ERROR_IO;
+            break;
+    }
+
+    if (!reader->error)
+    {
+        reader->error = libusb_submit_transfer(transfer);
+    }
+
+    if (reader->error)
+    {
+        readTransfer->idle = true;
+        reader->pending--;
+        reader->cancelCondition.notify_all();
+    }
+
+    lock.unlock();
+
+    // Callbacks also run on threads performing synchronous transfers
+    reader->device->manager.wakeEventThread();
+}
+
+UsbDeviceManager::UsbDeviceManager() : stopEvents(false)
 {
     int error = libusb_init(nullptr);
 
@@ -161,35 +867,75 @@ UsbDeviceManager::UsbDeviceManager()
     {
         throw UsbException("Error initializing libusb", error);
     }
+
+    eventThread = std::thread(&UsbDeviceManager::handleEvents, this);
 }
 
 UsbDeviceManager::~UsbDeviceManager()
 {
+    std::unique_lock<std::mutex> lock(hotplugMutex);
+
+    stopHotplug = true;
+    hotplugCondition.notify_one();
+    lock.unlock();
+
+    if (hotplugThread.joinable())
+    {
+        hotplugThread.join();
+    }
+
+    for (libusb_hotplug_callback_handle handle : hotplugHandles)
+    {
+        libusb_hotplug_deregister_callback(nullptr, handle);
+    }
+
+    // Owner releases its devices before libusb shuts down
+    while (!openDevices.empty())
+    {
+        closeDevice(openDevices.begin()->first);
+    }
+
+    for (DeviceEvent &event : hotplugEvents)
+    {
+        libusb_unref_device(event.device);
+    }
+
+    stopEvents = true;
+
+    libusb_interrupt_event_handler(nullptr);
+
+    if (eventThread.joinable())
+    {
+        eventThread.join();
+    }
+
     libusb_exit(nullptr);
 }
 
-std::unique_ptr<UsbDevice> UsbDeviceManager::getDevice(
+void UsbDeviceManager::watchDevices(
     std::initializer_list<HardwareId> ids,
-    UsbDevice::Terminate terminate
+    DeviceAdded added,
+    DeviceRemoved removed
 ) {
-    std::vector<libusb_hotplug_callback_handle> handles(ids.size());
-    size_t counter = 0;
-    libusb_device *device = nullptr;
+    deviceAdded = added;
+    deviceRemoved = removed;
 
     for (HardwareId id : ids)
     {
+        libusb_hotplug_callback_handle handle = {};
         int error = libusb_hotplug_register_callback(
             nullptr,
             static_cast<libusb_hotplug_event>(
-                LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+                LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT
             ),
             LIBUSB_HOTPLUG_ENUMERATE,
             id.vendorId,
             id.productId,
             LIBUSB_HOTPLUG_MATCH_ANY,
             hotplugCallback,
-            &device,
-            &handles[counter]
+            this,
+            &handle
         );
 
         if (error)
@@ -197,33 +943,245 @@ std::unique_ptr<UsbDevice> UsbDeviceManager::getDevice(
             throw UsbException("Error registering hotplug", error);
         }
 
-        counter++;
+        hotplugHandles.push_back(handle);
     }
 
     Log::info("Waiting for device...");
 
-    // Handle events until device is plugged in
-    while (!device)
+    hotplugThread = std::thread(&UsbDeviceManager::handleDevices, this);
+}
+
+void UsbDeviceManager::handleEvents()
+{
+    Clock::time_point deadline = Clock::time_point::max();
+
+    while (!stopEvents)
     {
-        int error = libusb_handle_events_completed(nullptr, nullptr);
+        // Blocks until a transfer completes or the thread is woken
+        // Wakes up in time for the next scheduled read retry
+        int error = 0;
 
-        if (error)
+        if (deadline == Clock::time_point::max())
+        {
+            error = libusb_handle_events_completed(nullptr, nullptr);
+        }
+
+        else
+        {
+            timeval timeout = {};
+            Clock::duration remaining = deadline - Clock::now();
+            long long micros = std::chrono::duration_cast<
+                std::chrono::microseconds
+            >(remaining).count();
+
+            if (micros > 0)
+            {
+                timeout.tv_sec = micros / 1000000;
+                timeout.tv_usec = micros % 1000000;
+            }
+
+            error = libusb_handle_events_timeout_completed(
+                nullptr,
+                &timeout,
+                nullptr
+            );
+        }
+
+        if (error && error != LIBUSB_ERROR_INTERRUPTED)
+        {
+            Log::error("Error handling events: %s", libusb_error_name(error));
+
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(deviceMutex);
+
+        deadline = Clock::time_point::max();
+
+        for (LibusbDevice *device : devices)
         {
-            throw UsbException("Error handling events", error);
+            deadline = std::min(deadline, device->dispatchReads());
         }
     }
+}
 
-    // Remove all hotplug callbacks
-    for (libusb_hotplug_callback_handle handle : handles)
+void UsbDeviceManager::handleDevices()
+{
+    std::unique_lock<std::mutex> lock(hotplugMutex);
+
+    while (true)
     {
-        libusb_hotplug_deregister_callback(nullptr, handle);
+        hotplugCondition.wait(lock, [this] {
+            return stopHotplug || !hotplugEvents.empty();
+        });
+
+        if (stopHotplug)
+        {
+            break;
+        }
+
+        DeviceEvent event = hotplugEvents.front();
+
+        hotplugEvents.pop_front();
+        lock.unlock();
+
+        auto entry = openDevices.find(event.device);
+        bool opened = entry != openDevices.end();
+
+        if (event.type == DEVICE_ARRIVED && !opened)
+        {
+            openDevice(event.device, 0);
+        }
+
+        else if (event.type == DEVICE_LEFT && opened)
+        {
+            closeDevice(event.device);
+
+            Log::info("Device disconnected");
+        }
+
+        // Failures of previous instances are outdated
+        else if (
+            event.type == DEVICE_FAILED &&
+            opened &&
+            event.generation == entry->second.generation
+        ) {
+            OpenDevice failed = entry->second;
+            uint32_t recoveries = failed.recoveries + 1;
+
+            // Devices that keep failing right after opening are given up on
+            if (
+                std::chrono::steady_clock::now() - failed.openTime >
+                USB_RECOVERY_WINDOW
+            ) {
+                recoveries = 0;
+            }
+
+            closeDevice(event.device);
+
+            if (recoveries > USB_MAX_RECOVERIES)
+            {
+                Log::error("Device keeps failing, giving up");
+            }
+
+            else
+            {
+                openDevice(event.device, recoveries);
+            }
+        }
+
+        libusb_unref_device(event.device);
+        lock.lock();
     }
+}
 
-    // Pass ownership of device to caller
-    return std::unique_ptr<UsbDevice>(new UsbDevice(
+void UsbDeviceManager::openDevice(
+    libusb_device *device,
+    uint32_t recoveries
+) {
+    UsbDevice::Terminate terminate = std::bind(
+        &UsbDeviceManager::queueDeviceEvent,
+        this,
+        DEVICE_FAILED,
         device,
-        terminate
-    ));
+        ++lastGeneration
+    );
+
+    try
+    {
+        std::unique_ptr<UsbDevice> usbDevice(new LibusbDevice(
+            device,
+            *this,
+            terminate,
+            recoveryPolicy
+        ));
+
+        OpenDevice openDevice = {
+            usbDevice.get(),
+            std::chrono::steady_clock::now(),
+            recoveries,
+            lastGeneration
+        };
+
+        // Pass ownership of device to owner
+        if (deviceAdded(std::move(usbDevice)))
+        {
+            openDevices[libusb_ref_device(device)] = openDevice;
+
+            return;
+        }
+    }
+
+    catch (UsbException &exception)
+    {
+        Log::error(exception.what());
+
+        return;
+    }
+
+    // Initialization might fail because of a transient error
+    if (recoveries < USB_MAX_RECOVERIES)
+    {
+        openDevice(device, recoveries + 1);
+    }
+}
+
+void UsbDeviceManager::closeDevice(libusb_device *device)
+{
+    auto entry = openDevices.find(device);
+
+    if (entry == openDevices.end())
+    {
+        return;
+    }
+
+    // Owner destroys the device
+    deviceRemoved(entry->second.device);
+    libusb_unref_device(entry->first);
+
+    openDevices.erase(entry);
+}
+
+void UsbDeviceManager::queueDeviceEvent(
+    DeviceEventType type,
+    libusb_device *device,
+    uint64_t generation
+) {
+    std::lock_guard<std::mutex> lock(hotplugMutex);
+
+    hotplugEvents.push_back({ type, libusb_ref_device(device), generation });
+    hotplugCondition.notify_one();
+}
+
+void UsbDeviceManager::addDevice(LibusbDevice *device)
+{
+    std::lock_guard<std::mutex> lock(deviceMutex);
+
+    devices.push_back(device);
+}
+
+void UsbDeviceManager::removeDevice(LibusbDevice *device)
+{
+    std::lock_guard<std::mutex> lock(deviceMutex);
+
+    devices.erase(
+        std::remove(devices.begin(), devices.end(), device),
+        devices.end()
+    );
+}
+
+void UsbDeviceManager::wakeEventThread()
+{
+    // The event thread dispatches its own completions
+    if (!isEventThread())
+    {
+        libusb_interrupt_event_handler(nullptr);
+    }
+}
+
+bool UsbDeviceManager::isEventThread() const
+{
+    return std::this_thread::get_id() == eventThread.get_id();
 }
 
 int UsbDeviceManager::hotplugCallback(
@@ -232,12 +1190,19 @@ int UsbDeviceManager::hotplugCallback(
     libusb_hotplug_event event,
     void *userData
 ) {
-    libusb_device **newDevice = static_cast<libusb_device**>(userData);
+    UsbDeviceManager *manager = static_cast<UsbDeviceManager*>(userData);
 
-    *newDevice = device;
+    // Devices cannot be opened from within a libusb callback
+    manager->queueDeviceEvent(
+        event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+            ? DEVICE_ARRIVED
+            : DEVICE_LEFT,
+        device,
+        0
+    );
 
-    // Deregister hotplug callback
-    return 1;
+    // Keep watching for devices
+    return 0;
 }
 
 UsbException::UsbException(
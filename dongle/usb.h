@@ -19,25 +19,63 @@
 #pragma once
 
 #include "../utils/bytes.h"
+#include "../utils/pool.h"
+#include "../utils/stats.h"
 
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
 #include <libusb-1.0/libusb.h>
 
 #define USB_MAX_BULK_TRANSFER_SIZE 512
 
+// Largest receive buffer a read can use
+// Devices may combine several packets into a single transfer
+#define USB_MAX_READ_SIZE 0x8000
+
+// Number of transfers kept in flight per endpoint
+#define USB_READ_TRANSFERS 4
+
+// Number of receive buffers per endpoint
+// Includes buffers of in-flight transfers
+#define USB_READ_BUFFERS 16
+
+// Both directions of all possible endpoint numbers
+#define USB_ENDPOINT_COUNT 32
+
+// Largest bulk write staged in device memory
+// Fits a firmware chunk including its headers
+#define USB_WRITE_BUFFER_SIZE 0x4000
+
+// Default recovery policy for failed transfers
+// Retries are delayed by an exponentially growing backoff
+#define USB_RECOVERY_RETRIES 3
+#define USB_RECOVERY_BACKOFF std::chrono::milliseconds(5)
+#define USB_RECOVERY_CLEAR_HALT true
+
+class UsbDeviceManager;
+
 /*
  * Base class for interfacing with USB devices
  * Provides control/bulk transfer capabilities
+ * Implemented by different transports
  */
 class UsbDevice
 {
 public:
     using Terminate = std::function<void()>;
+    using Receive = std::function<void(const PooledBytes &data)>;
 
     struct ControlPacket
     {
@@ -48,24 +86,198 @@ public:
         uint16_t length;
     };
 
-    UsbDevice(libusb_device *device, Terminate terminate);
-    virtual ~UsbDevice();
+    virtual ~UsbDevice() = default;
 
-    void controlTransfer(ControlPacket packet, bool write);
-    int bulkRead(
+    virtual void controlTransfer(ControlPacket packet, bool write) = 0;
+    // Each received transfer fits into the given buffer size
+    virtual bool startRead(
         uint8_t endpoint,
-        FixedBytes<USB_MAX_BULK_TRANSFER_SIZE> &buffer
+        Receive receive,
+        size_t size = USB_MAX_BULK_TRANSFER_SIZE
+    ) = 0;
+    // Returns once no handler is running, except for a calling handler
+    virtual void stopRead() = 0;
+    virtual bool bulkWrite(uint8_t endpoint, Bytes &data) = 0;
+
+    /* Statistics */
+    const TransferStats& getStats(uint8_t endpoint) const;
+    uint64_t getTransfers() const;
+    void logStats(const std::string &name) const;
+
+protected:
+    // Control transfers are accounted to endpoint zero
+    TransferStats& endpointStats(uint8_t endpoint);
+
+private:
+    TransferStats stats[USB_ENDPOINT_COUNT];
+};
+
+/*
+ * USB device accessed through libusb
+ * Received data is dispatched by the manager's event thread
+ */
+class LibusbDevice : public UsbDevice
+{
+public:
+    /*
+     * Steps taken before a failed transfer terminates the device
+     * Retries come first, followed by clearing a halted endpoint
+     * Failed devices are reset and reopened by the manager
+     */
+    struct RecoveryPolicy
+    {
+        uint32_t retries;
+        std::chrono::milliseconds backoff;
+        bool clearHalt;
+    };
+
+    LibusbDevice(
+        libusb_device *device,
+        UsbDeviceManager &manager,
+        Terminate terminate,
+        RecoveryPolicy policy
     );
-    bool bulkWrite(uint8_t endpoint, Bytes &data);
+    ~LibusbDevice();
+
+    void controlTransfer(ControlPacket packet, bool write) override;
+    bool startRead(
+        uint8_t endpoint,
+        Receive receive,
+        size_t size = USB_MAX_BULK_TRANSFER_SIZE
+    ) override;
+    void stopRead() override;
+    bool bulkWrite(uint8_t endpoint, Bytes &data) override;
 
 private:
+    friend class UsbDeviceManager;
+
+    struct BulkReader;
+
+    // Progress through the recovery policy for a single transfer
+    struct Recovery
+    {
+        uint32_t retries = 0;
+        bool clearedHalt = false;
+
+        // Transfer is not resubmitted before the backoff has passed
+        LatencyHistogram::Clock::time_point retryTime;
+    };
+
+    /*
+     * Memory the kernel can use for transfers without copying
+     * Falls back to heap memory if the kernel does not support it
+     */
+    class DeviceMemory
+    {
+    public:
+        DeviceMemory(libusb_device_handle *handle, size_t size);
+        ~DeviceMemory();
+
+        DeviceMemory(const DeviceMemory &other) = delete;
+        DeviceMemory& operator=(const DeviceMemory &other) = delete;
+
+        inline uint8_t* raw() { return data; }
+        inline size_t size() const { return length; }
+        inline bool isMapped() const { return mapped; }
+
+    private:
+        libusb_device_handle *handle;
+        uint8_t *data;
+        size_t length;
+        bool mapped;
+    };
+
+    struct ReadTransfer
+    {
+        BulkReader *reader;
+        libusb_transfer *transfer;
+        PooledBytes buffer;
+
+        // Failed transfers wait to be resubmitted after recovery
+        // Transfers without buffer wait for one to be released
+        bool idle;
+    };
+
+    /*
+     * Keeps multiple transfers queued on a single endpoint
+     * Completed transfers are resubmitted from the callback
+     * Received data stays in the pool's buffers until released
+     */
+    struct BulkReader
+    {
+        BulkReader(libusb_device_handle *handle, size_t size) :
+            memory(handle, USB_READ_BUFFERS * size),
+            pool(USB_READ_BUFFERS, size, memory.raw()),
+            starved(false) {}
+
+        // Destroyed after the pool
+        DeviceMemory memory;
+        BytePool pool;
+
+        // Set while transfers are waiting for a buffer
+        // Outlives the buffers that are returned to the pool
+        std::atomic<bool> starved;
+
+        LibusbDevice *device;
+        uint8_t endpoint;
+        Receive receive;
+        TransferStats *stats;
+
+        std::vector<ReadTransfer> transfers;
+
+        // Ring of received packets waiting to be dispatched
+        std::mutex mutex;
+        std::vector<PooledBytes> packets;
+        std::vector<LatencyHistogram::Clock::time_point> packetTimes;
+        size_t packetStart = 0;
+        size_t packetCount = 0;
+
+        // Completion time of the most recent transfer
+        LatencyHistogram::Clock::time_point lastArrival;
+
+        size_t pending = 0;
+        int error = 0;
+        bool stopping = false;
+        std::condition_variable cancelCondition;
+
+        // Only used by the event thread
+        Recovery recovery;
+        bool retryScheduled = false;
+    };
+
+    LatencyHistogram::Clock::time_point dispatchReads();
+    void resumeReader(BulkReader &reader);
+    LatencyHistogram::Clock::time_point recoverReader(BulkReader &reader);
+    bool recover(uint8_t endpoint, int error, Recovery &recovery);
+    void cancelReader(BulkReader &reader);
+    void closeReader(BulkReader &reader);
+    void fail();
+
+    static void readCallback(libusb_transfer *transfer);
+
     libusb_device_handle *handle;
+    UsbDeviceManager &manager;
     Terminate terminate;
+    RecoveryPolicy policy;
+    std::atomic<bool> failed;
+
+    // Serializes clearing halts
+    std::mutex recoveryMutex;
+
+    // Bulk writes are staged in device memory if available
+    std::mutex writeMutex;
+    std::unique_ptr<DeviceMemory> writeMemory;
+
+    // Held while received data is being dispatched
+    std::mutex readerMutex;
+    std::map<uint8_t, std::unique_ptr<BulkReader>> readers;
 };
 
 /*
  * Provides access to USB devices
  * Handles device enumeration and hot plugging
+ * Any number of devices share one event thread
+ * Reopens devices after failures without restarting
  */
 class UsbDeviceManager
 {
@@ -75,21 +287,95 @@ public:
         uint16_t vendorId, productId;
     };
 
+    // Owner returns false if it could not make use of the device
+    using DeviceAdded = std::function<bool(std::unique_ptr<UsbDevice> device)>;
+    using DeviceRemoved = std::function<void(UsbDevice *device)>;
+
     UsbDeviceManager();
     ~UsbDeviceManager();
 
-    std::unique_ptr<UsbDevice> getDevice(
+    void watchDevices(
         std::initializer_list<HardwareId> ids,
-        UsbDevice::Terminate terminate
+        DeviceAdded added,
+        DeviceRemoved removed
     );
 
 private:
+    friend class LibusbDevice;
+
+    enum DeviceEventType
+    {
+        DEVICE_ARRIVED,
+        DEVICE_LEFT,
+        DEVICE_FAILED,
+    };
+
+    // Failures carry the generation of the instance that failed
+    struct DeviceEvent
+    {
+        DeviceEventType type;
+        libusb_device *device;
+        uint64_t generation;
+    };
+
+    // Device that was passed to the owner
+    struct OpenDevice
+    {
+        UsbDevice *device;
+        std::chrono::steady_clock::time_point openTime;
+        uint32_t recoveries;
+        uint64_t generation;
+    };
+
+    void handleEvents();
+    void handleDevices();
+    void openDevice(libusb_device *device, uint32_t recoveries);
+    void closeDevice(libusb_device *device);
+    void queueDeviceEvent(
+        DeviceEventType type,
+        libusb_device *device,
+        uint64_t generation
+    );
+    void addDevice(LibusbDevice *device);
+    void removeDevice(LibusbDevice *device);
+    void wakeEventThread();
+    bool isEventThread() const;
+
     static int hotplugCallback(
         libusb_context *context,
         libusb_device *device,
         libusb_hotplug_event event,
         void *userData
     );
+
+    std::thread eventThread;
+    std::atomic<bool> stopEvents;
+
+    std::mutex deviceMutex;
+    std::vector<LibusbDevice*> devices;
+
+    // Devices are opened and closed on a separate thread
+    std::thread hotplugThread;
+    std::mutex hotplugMutex;
+    std::condition_variable hotplugCondition;
+    std::deque<DeviceEvent> hotplugEvents;
+    std::vector<libusb_hotplug_callback_handle> hotplugHandles;
+    bool stopHotplug = false;
+
+    DeviceAdded deviceAdded;
+    DeviceRemoved deviceRemoved;
+
+    // Referenced libusb devices and their owned counterparts
+    std::map<libusb_device*, OpenDevice> openDevices;
+
+    // Incremented for every instance that is opened
+    uint64_t lastGeneration = 0;
+
+    const LibusbDevice::RecoveryPolicy recoveryPolicy = {
+        USB_RECOVERY_RETRIES,
+        USB_RECOVERY_BACKOFF,
+        USB_RECOVERY_CLEAR_HALT
+    };
 };
 
 class UsbException : public std::runtime_error
@@ -20,8 +20,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <algorithm>
 #include <vector>
-#include <array>
 
 /*
  * Simple wrapper for byte vectors
@@ -98,6 +98,11 @@ public:
         data.insert(data.end(), begin, end);
     }
 
+    inline void append(const uint8_t *begin, const uint8_t *end)
+    {
+        data.insert(data.end(), begin, end);
+    }
+
     template<typename T>
     inline void append(const T &object, size_t size = sizeof(T))
     {
@@ -124,6 +129,11 @@ public:
         data.clear();
     }
 
+    inline void reserve(size_t count)
+    {
+        data.reserve(count);
+    }
+
     inline uint8_t operator[](size_t index) const
     {
         return data[index];
@@ -149,31 +159,91 @@ private:
 };
 
 /*
- * Simple wrapper for byte arrays
- * Provides utility functions
+ * Non-owning view of a range of bytes
+ * Accesses outside of the range are caught
+ * The viewed memory must outlive the view
  */
-template<size_t S>
-class FixedBytes
+class ByteView
 {
 public:
-    inline Bytes toBytes(size_t count) const
+    inline ByteView() : first(nullptr), last(nullptr) {}
+
+    inline ByteView(
+        const uint8_t *begin,
+        const uint8_t *end
+    ) : first(begin), last(end) {}
+
+    inline ByteView(
+        const Bytes &bytes
+    ) : first(bytes.raw()), last(bytes.raw() + bytes.size()) {}
+
+    inline const uint8_t* begin() const
     {
-        return Bytes(
-            data.begin(),
-            data.begin() + count
-        );
+        return first;
+    }
+
+    inline const uint8_t* end() const
+    {
+        return last;
     }
 
     inline size_t size() const
     {
-        return data.size();
+        return last - first;
     }
 
-    inline uint8_t* raw()
+    inline const uint8_t* raw() const
     {
-        return data.data();
+        return first;
+    }
+
+    // Returns null if the struct exceeds the view
+    template<typename T>
+    inline const T* toStruct(size_t offset = 0) const
+    {
+        if (offset > size() || size() - offset < sizeof(T))
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const T*>(first + offset);
+    }
+
+    // Returns an empty view if more bytes are skipped than available
+    inline ByteView skip(size_t skipBegin, size_t skipEnd = 0) const
+    {
+        if (skipBegin + skipEnd > size())
+        {
+            return ByteView();
+        }
+
+        return ByteView(first + skipBegin, last - skipEnd);
+    }
+
+    // Copies the viewed bytes
+    inline Bytes toBytes() const
+    {
+        return Bytes(first, last);
+    }
+
+    // Bytes outside of the view read as zero
+    inline uint8_t operator[](size_t index) const
+    {
+        return index < size() ? first[index] : 0;
+    }
+
+    inline bool operator==(const Bytes &other) const
+    {
+        return size() == other.size() &&
+            std::equal(first, last, other.raw());
+    }
+
+    inline bool operator!=(const Bytes &other) const
+    {
+        return !(*this == other);
     }
 
 private:
-    std::array<uint8_t, S> data;
+    const uint8_t *first;
+    const uint8_t *last;
 };
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "mapping.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(std::string path)
+{
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (file < 0)
+    {
+        throw MappedFileException("Error opening file", errno);
+    }
+
+    struct stat status = {};
+
+    if (fstat(file, &status) < 0)
+    {
+        // Closing the file might overwrite errno
+        int error = errno;
+
+        close(file);
+
+        throw MappedFileException("Error reading file size", error);
+    }
+
+    if (status.st_size <= 0)
+    {
+        close(file);
+
+        throw MappedFileException("File is empty");
+    }
+
+    length = status.st_size;
+
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        int error = errno;
+
+        close(file);
+
+        throw MappedFileException("Error mapping file", error);
+    }
+
+    // Mapping stays valid after closing the file
+    close(file);
+
+    // Whole file is read sequentially
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    madvise(mapping, length, MADV_WILLNEED);
+
+    data = static_cast<const uint8_t*>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<uint8_t*>(data), length);
+}
+
+MappedFileException::MappedFileException(
+    std::string message
+) : std::runtime_error(message) {}
+
+MappedFileException::MappedFileException(
+    std::string message,
+    int error
+) : std::runtime_error(message + ": " + strerror(error)) {}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+/*
+ * Read-only memory mapping of a whole file
+ * Pages are loaded by the kernel on first access
+ */
+class MappedFile
+{
+public:
+    MappedFile(std::string path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile& operator=(const MappedFile &other) = delete;
+
+    inline const uint8_t* begin() const
+    {
+        return data;
+    }
+
+    inline const uint8_t* end() const
+    {
+        return data + length;
+    }
+
+    inline size_t size() const
+    {
+        return length;
+    }
+
+    template<typename T>
+    inline const T* toStruct(size_t offset = 0) const
+    {
+        return reinterpret_cast<const T*>(data + offset);
+    }
+
+private:
+    const uint8_t *data;
+    size_t length;
+};
+
+class MappedFileException : public std::runtime_error
+{
+public:
+    MappedFileException(std::string message);
+    MappedFileException(std::string message, int error);
+};
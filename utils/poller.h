@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+/*
+ * Repeatedly checks a condition until it is met or a deadline passes
+ * Delays between checks grow exponentially up to a limit
+ * Keeps counters of all polls for diagnostics
+ */
+class Poller
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Delay = std::chrono::microseconds;
+
+    // Returns true while the awaited state has not been reached
+    using Pending = std::function<bool()>;
+
+    struct Config
+    {
+        Delay minDelay;
+        Delay maxDelay;
+        Clock::duration deadline;
+    };
+
+    inline Poller(Config config) :
+        config(config), polls(0), checks(0), timeouts(0), waited(0) {}
+
+    inline bool poll(Pending pending)
+    {
+        Clock::time_point start = Clock::now();
+        Clock::time_point now = start;
+        Delay delay = config.minDelay;
+        bool successful = true;
+
+        polls.fetch_add(1, std::memory_order_relaxed);
+
+        while (true)
+        {
+            checks.fetch_add(1, std::memory_order_relaxed);
+
+            if (!pending())
+            {
+                break;
+            }
+
+            now = Clock::now();
+
+            if (now - start > config.deadline)
+            {
+                timeouts.fetch_add(1, std::memory_order_relaxed);
+                successful = false;
+
+                break;
+            }
+
+            std::this_thread::sleep_for(delay);
+
+            delay = std::min(delay * 2, config.maxDelay);
+        }
+
+        now = Clock::now();
+        waited.fetch_add(
+            std::chrono::duration_cast<Delay>(now - start).count(),
+            std::memory_order_relaxed
+        );
+
+        return successful;
+    }
+
+    inline uint64_t getPolls() const
+    {
+        return polls.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t getChecks() const
+    {
+        return checks.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t getTimeouts() const
+    {
+        return timeouts.load(std::memory_order_relaxed);
+    }
+
+    // Total time spent polling in microseconds
+    inline uint64_t getWaited() const
+    {
+        return waited.load(std::memory_order_relaxed);
+    }
+
+private:
+    Config config;
+
+    std::atomic<uint64_t> polls;
+    std::atomic<uint64_t> checks;
+    std::atomic<uint64_t> timeouts;
+    std::atomic<uint64_t> waited;
+};
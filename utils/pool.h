@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class BytePool;
+
+/*
+ * Reference-counted view of a buffer borrowed from a pool
+ * The buffer returns to its pool once the last view is released
+ */
+class PooledBytes
+{
+public:
+    inline PooledBytes() : slot(nullptr) {}
+
+    inline PooledBytes(const PooledBytes &other) : slot(other.slot)
+    {
+        if (slot)
+        {
+            slot->references.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    inline PooledBytes(PooledBytes &&other) : slot(other.slot)
+    {
+        other.slot = nullptr;
+    }
+
+    inline ~PooledBytes()
+    {
+        release();
+    }
+
+    inline PooledBytes& operator=(PooledBytes other)
+    {
+        std::swap(slot, other.slot);
+
+        return *this;
+    }
+
+    inline explicit operator bool() const
+    {
+        return slot != nullptr;
+    }
+
+    inline size_t size() const
+    {
+        return slot->length;
+    }
+
+    inline size_t capacity() const
+    {
+        return slot->capacity;
+    }
+
+    inline void resize(size_t count)
+    {
+        slot->length = count < slot->capacity ? count : slot->capacity;
+    }
+
+    inline const uint8_t* raw() const
+    {
+        return slot->data;
+    }
+
+    inline uint8_t* raw()
+    {
+        return slot->data;
+    }
+
+    template<typename T>
+    inline const T* toStruct(size_t offset = 0) const
+    {
+        return reinterpret_cast<const T*>(slot->data + offset);
+    }
+
+    inline uint8_t operator[](size_t index) const
+    {
+        return slot->data[index];
+    }
+
+private:
+    friend class BytePool;
+
+    struct Slot
+    {
+        BytePool *pool;
+        uint8_t *data;
+        size_t capacity;
+        size_t length;
+        std::atomic<uint32_t> references;
+    };
+
+    inline explicit PooledBytes(Slot *slot) : slot(slot) {}
+
+    inline void release();
+
+    Slot *slot;
+};
+
+/*
+ * Fixed number of equally sized buffers allocated up front
+ * Taking and returning buffers never allocates memory
+ * All buffers must be released before the pool is destroyed
+ */
+class BytePool
+{
+public:
+    // Called whenever a buffer becomes available again
+    using Release = std::function<void()>;
+
+    inline BytePool(size_t count, size_t size) :
+        BytePool(count, size, nullptr) {}
+
+    // Uses memory of at least count * size bytes owned by the caller
+    // The memory must outlive the pool, heap memory is used for null
+    inline BytePool(size_t count, size_t size, uint8_t *memory) :
+        ownedMemory(memory ? nullptr : new uint8_t[count * size]),
+        slots(new PooledBytes::Slot[count])
+    {
+        uint8_t *base = memory ? memory : ownedMemory.get();
+
+        available.reserve(count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            PooledBytes::Slot &slot = slots[i];
+
+            slot.pool = this;
+            slot.data = base + i * size;
+            slot.capacity = size;
+            slot.length = 0;
+            slot.references = 0;
+
+            available.push_back(&slot);
+        }
+    }
+
+    // Returns an empty view if the pool is exhausted
+    inline PooledBytes get()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (available.empty())
+        {
+            return PooledBytes();
+        }
+
+        PooledBytes::Slot *slot = available.back();
+
+        available.pop_back();
+
+        slot->length = slot->capacity;
+        slot->references = 1;
+
+        return PooledBytes(slot);
+    }
+
+    // Must be set before any buffer is taken
+    inline void setReleaseHandler(Release handler)
+    {
+        release = handler;
+    }
+
+private:
+    friend class PooledBytes;
+
+    inline void put(PooledBytes::Slot *slot)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        available.push_back(slot);
+        lock.unlock();
+
+        if (release)
+        {
+            release();
+        }
+    }
+
+    std::unique_ptr<uint8_t[]> ownedMemory;
+    std::unique_ptr<PooledBytes::Slot[]> slots;
+
+    std::mutex mutex;
+    std::vector<PooledBytes::Slot*> available;
+    Release release;
+};
+
+inline void PooledBytes::release()
+{
+    if (!slot)
+    {
+        return;
+    }
+
+    if (slot->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        slot->pool->put(slot);
+    }
+
+    slot = nullptr;
+}
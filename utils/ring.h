@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+
+/*
+ * Single consumer/producer lock-free ring of fixed size
+ * Holds at most one item less than its size
+ * Concurrent access from multiple consumers or producers requires locking
+ */
+template<typename T, size_t N>
+class Ring
+{
+public:
+    Ring() : head(0), tail(0) {}
+
+    // Returns false if the ring is full
+    bool push(const T &item)
+    {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % N;
+
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        items[current] = item;
+        tail.store(next, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        size_t current = head.load(std::memory_order_relaxed);
+
+        if (current == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = items[current];
+        head.store((current + 1) % N, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    T items[N];
+    std::atomic<size_t> head, tail;
+};
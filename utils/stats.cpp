@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "stats.h"
+
+#include <sstream>
+
+std::string LatencyHistogram::format() const
+{
+    std::ostringstream stream;
+
+    for (size_t i = 0; i < STATS_LATENCY_BUCKETS; i++)
+    {
+        uint64_t count = get(i);
+
+        if (!count)
+        {
+            continue;
+        }
+
+        if (i == STATS_LATENCY_BUCKETS - 1)
+        {
+            stream << ">=" << (1ull << i) << "us: " << count << ' ';
+        }
+
+        else
+        {
+            stream << '<' << (2ull << i) << "us: " << count << ' ';
+        }
+    }
+
+    std::string output = stream.str();
+
+    if (output.empty())
+    {
+        return "none";
+    }
+
+    // Remove trailing space
+    output.pop_back();
+
+    return output;
+}
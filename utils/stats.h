@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021 Medusalix
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Buckets are powers of two in microseconds
+// The last bucket also contains all higher latencies
+#define STATS_LATENCY_BUCKETS 16
+
+/*
+ * Lock-free histogram with logarithmic buckets
+ * Recording only costs a single relaxed atomic increment
+ */
+class LatencyHistogram
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline LatencyHistogram()
+    {
+        for (std::atomic<uint64_t> &bucket : buckets)
+        {
+            bucket = 0;
+        }
+    }
+
+    inline void record(Clock::duration latency)
+    {
+        uint64_t micros = std::chrono::duration_cast<
+            std::chrono::microseconds
+        >(latency).count();
+        size_t index = 63 - __builtin_clzll(micros | 1);
+
+        if (index >= STATS_LATENCY_BUCKETS)
+        {
+            index = STATS_LATENCY_BUCKETS - 1;
+        }
+
+        buckets[index].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline uint64_t get(size_t index) const
+    {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+
+    // Lists all non-empty buckets by their upper bound
+    std::string format() const;
+
+private:
+    std::atomic<uint64_t> buckets[STATS_LATENCY_BUCKETS];
+};
+
+/*
+ * Counters for the transfers of a single endpoint
+ * Safe to update from any number of threads
+ */
+class TransferStats
+{
+public:
+    inline TransferStats() :
+        transfers(0), bytes(0), timeouts(0), errors(0),
+        retries(0), clearedHalts(0) {}
+
+    inline void recordTransfer(size_t count)
+    {
+        transfers.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    inline void recordTransfer(
+        size_t count,
+        LatencyHistogram::Clock::duration duration
+    ) {
+        recordTransfer(count);
+        latency.record(duration);
+    }
+
+    inline void recordTimeout()
+    {
+        timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void recordError()
+    {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void recordRetry()
+    {
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void recordClearHalt()
+    {
+        clearedHalts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline bool empty() const
+    {
+        return !transfers && !timeouts && !errors;
+    }
+
+    std::atomic<uint64_t> transfers;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> timeouts;
+    std::atomic<uint64_t> errors;
+
+    // Steps taken to recover from errors
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> clearedHalts;
+
+    // Time from submission until completion
+    LatencyHistogram latency;
+
+    // Reads are queued in advance, only their arrival can be timed
+    LatencyHistogram interval;
+
+    // Time from completion until the data has been handled
+    LatencyHistogram processing;
+};
+
+/*
+ * Durations of consecutive phases of a longer operation
+ * Each phase also counts the transfers it caused
+ */
+class PhaseProfile
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase
+    {
+        std::string name;
+        Clock::duration duration;
+        uint64_t transfers;
+    };
+
+    // Ends the current phase
+    inline void begin(std::string name, uint64_t transfers)
+    {
+        end(transfers);
+
+        currentName = name;
+        currentStart = Clock::now();
+        currentTransfers = transfers;
+        running = true;
+    }
+
+    inline void end(uint64_t transfers)
+    {
+        if (!running)
+        {
+            return;
+        }
+
+        phases.push_back({
+            currentName,
+            Clock::now() - currentStart,
+            transfers - currentTransfers
+        });
+
+        running = false;
+    }
+
+    inline const std::vector<Phase>& getPhases() const
+    {
+        return phases;
+    }
+
+    inline Clock::duration getTotal() const
+    {
+        Clock::duration total = Clock::duration::zero();
+
+        for (const Phase &phase : phases)
+        {
+            total += phase.duration;
+        }
+
+        return total;
+    }
+
+private:
+    std::vector<Phase> phases;
+
+    std::string currentName;
+    Clock::time_point currentStart;
+    uint64_t currentTransfers = 0;
+    bool running = false;
+};
@@ -22,6 +22,9 @@
 #include "dongle/dongle.h"
 
 #include <cstring>
+#include <memory>
+#include <map>
+#include <mutex>
 #include <csignal>
 #include <sys/signalfd.h>
 
@@ -36,8 +39,9 @@ int main()
     sigaddset(&signalMask, SIGINT);
     sigaddset(&signalMask, SIGTERM);
     sigaddset(&signalMask, SIGUSR1);
+    sigaddset(&signalMask, SIGUSR2);
 
-    // Block signals for all USB threads
+    // Block signals for all USB threads and pass them to the signalfd
     if (pthread_sigmask(SIG_BLOCK, &signalMask, nullptr) < 0)
     {
         Log::error("Error blocking signals: %s", strerror(errno));
@@ -45,50 +49,75 @@ int main()
         return EXIT_FAILURE;
     }
 
-    UsbDeviceManager manager;
+    int file = signalfd(-1, &signalMask, 0);
 
-    // Unblock signals for current thread to allow interruption
-    if (pthread_sigmask(SIG_UNBLOCK, &signalMask, nullptr) < 0)
+    if (file < 0)
     {
-        Log::error("Error unblocking signals: %s", strerror(errno));
+        Log::error("Error creating signal file: %s", strerror(errno));
 
         return EXIT_FAILURE;
     }
 
-    // Bind USB device termination to signal reader interruption
-    InterruptibleReader signalReader;
-    UsbDevice::Terminate terminate = std::bind(
-        &InterruptibleReader::interrupt,
-        &signalReader
-    );
-    std::unique_ptr<UsbDevice> device = manager.getDevice({
-        { DONGLE_VID, DONGLE_PID_OLD },
-        { DONGLE_VID, DONGLE_PID_NEW },
-        { DONGLE_VID, DONGLE_PID_SURFACE }
-    }, terminate);
+    // Every plugged in dongle gets its own instance
+    std::mutex dongleMutex;
+    std::map<UsbDevice*, std::unique_ptr<Dongle>> dongles;
 
-    // Block signals and pass them to the signalfd
-    if (pthread_sigmask(SIG_BLOCK, &signalMask, nullptr) < 0)
-    {
-        Log::error("Error blocking signals: %s", strerror(errno));
+    // Devices are passed in from the manager's hotplug thread
+    UsbDeviceManager::DeviceAdded added = [&](
+        std::unique_ptr<UsbDevice> device
+    ) {
+        UsbDevice *key = device.get();
+        std::unique_ptr<Dongle> dongle;
 
-        return EXIT_FAILURE;
-    }
+        try
+        {
+            dongle.reset(new Dongle(std::move(device)));
+        }
 
-    int file = signalfd(-1, &signalMask, 0);
+        catch (std::exception &exception)
+        {
+            Log::error("Error initializing dongle: %s", exception.what());
 
-    if (file < 0)
-    {
-        Log::error("Error creating signal file: %s", strerror(errno));
+            return false;
+        }
 
-        return EXIT_FAILURE;
-    }
+        std::lock_guard<std::mutex> lock(dongleMutex);
 
-    signalReader.prepare(file);
+        dongles[key] = std::move(dongle);
+
+        return true;
+    };
+    UsbDeviceManager::DeviceRemoved removed = [&](UsbDevice *device) {
+        std::unique_lock<std::mutex> lock(dongleMutex);
+        auto entry = dongles.find(device);
+
+        if (entry == dongles.end())
+        {
+            return;
+        }
+
+        std::unique_ptr<Dongle> dongle = std::move(entry->second);
+
+        dongles.erase(entry);
+        lock.unlock();
+
+        // Other dongles remain usable while this one shuts down
+        dongle.reset();
+    };
+
+    UsbDeviceManager manager;
+
+    manager.watchDevices({
+        { DONGLE_VID, DONGLE_PID_OLD },
+        { DONGLE_VID, DONGLE_PID_NEW },
+        { DONGLE_VID, DONGLE_PID_SURFACE }
+    }, added, removed);
 
-    Dongle dongle(std::move(device));
+    InterruptibleReader signalReader;
     signalfd_siginfo info = {};
 
+    signalReader.prepare(file);
+
     while (signalReader.read(&info, sizeof(info)))
     {
         uint32_t type = info.ssi_signo;
@@ -102,7 +131,22 @@ int main()
         {
             Log::debug("User signal received");
 
-            dongle.setPairingStatus(true);
+            std::lock_guard<std::mutex> lock(dongleMutex);
+
+            for (auto &entry : dongles)
+            {
+                entry.second->setPairingStatus(true);
+            }
+        }
+
+        if (type == SIGUSR2)
+        {
+            std::lock_guard<std::mutex> lock(dongleMutex);
+
+            for (auto &entry : dongles)
+            {
+                entry.second->logStats();
+            }
         }
     }
 